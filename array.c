@@ -1,7 +1,9 @@
 #include <stdlib.h> 
 #include <stdio.h> 
+#include <string.h>
 #include "list.h"
 #include "set.h" 
+#include "sort.h"
 
 
 #define MAXIMUM_ITEMS 100
@@ -37,12 +39,92 @@ set_t *set_create(cmpfunc_t cmpfunc)
     set->cmpfunc = cmpfunc;
     set->max_items = MAXIMUM_ITEMS;
     set->num_items = 0;
+    set->sorted = 1;
     set->array = calloc(set->max_items, sizeof(void*));
     
     return set;
 
 }
 
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set.  This implementation does not hash its
+ * elements, so the hash function is ignored.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc)
+{
+    return set_create(cmpfunc);
+}
+
+/*
+ * Creates a new set holding the n elements of the given array,
+ * sorted and deduplicated in one pass.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    set_t *set = set_create(cmpfunc);
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    if (!set_add_batch(set, elems, n))
+    {
+        set_destroy(set);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Creates a new set holding the elements of the given list.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list)
+{
+    int n = list_size(list);
+    void **elems = malloc((n + 1) * sizeof(void *));
+    list_iter_t *iter;
+    set_t *set;
+    int i = 0;
+
+    if (elems == NULL)
+    {
+        return NULL;
+    }
+
+    iter = list_createiter(list);
+    while (list_hasnext(iter))
+    {
+        elems[i++] = list_next(iter);
+    }
+    list_destroyiter(iter);
+
+    set = set_create_from_array(cmpfunc, elems, n);
+    free(elems);
+    return set;
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  This
+ * implementation does not hash its elements, so the hash function is
+ * ignored.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n)
+{
+    return set_create_from_array(cmpfunc, elems, n);
+}
+
+/*
+ * Creates a new set holding the elements of the given list, ignoring
+ * the hash function as above.
+ */
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list)
+{
+    return set_create_from_list(cmpfunc, list);
+}
+
 /*
  * Destroys the given set.  Subsequently accessing the set
  * will lead to undefined behavior.
@@ -55,30 +137,19 @@ void set_destroy(set_t *set)
 
 }
 
+/*
+ * Sorts the elements of the given set, unless they are already
+ * known to be sorted.
+ */
 void set_sort(set_t *set)
 {
-    int i, j;
-
-    for (i=0; i < set->num_items; i++)
+    if (set->sorted)
     {
-        void *tmp;
-        
-        for (j = i+1; j < set->num_items; j++)
-        {
-            if (set->cmpfunc(set->array[i],set->array[j]) > 0 )
-            {
-                tmp = set->array[i];
-                set->array[i] = set->array[j];
-                set->array[j] = tmp;
-
-            }
-                  
-        }
-
-        
-
+        return;
     }
 
+    sort_array(set->array, set->num_items, set->cmpfunc);
+    set->sorted = 1;
 }
 
 
@@ -110,10 +181,83 @@ void set_add(set_t *set, void *elem)
         set->max_items *= 2;   
     }
     
+    /* Appending after the largest element keeps a sorted set sorted */
+    if (set->sorted && set->num_items > 0 &&
+        set->cmpfunc(set->array[set->num_items - 1], elem) > 0)
+    {
+        set->sorted = 0;
+    }
+
     set->array[set->num_items] = elem;
     set->num_items++;    
 }
 
+/*
+ * Adds the n elements of the given array to the given set.
+ *
+ * The batch is sorted and deduplicated, and then merged with the
+ * (sorted) contents of the set into a new array.
+ */
+int set_add_batch(set_t *set, void **elems, int n)
+{
+    void **batch, **merged;
+    int i = 0, j = 0, k, m = 0;
+
+    if (n == 0)
+    {
+        return 1;
+    }
+    batch = malloc(n * sizeof(void *));
+    if (batch == NULL)
+    {
+        return 0;
+    }
+    memcpy(batch, elems, n * sizeof(void *));
+    k = sort_unique(batch, n, set->cmpfunc);
+
+    set_sort(set);
+    merged = malloc((set->num_items + k + 1) * sizeof(void *));
+    if (merged == NULL)
+    {
+        free(batch);
+        return 0;
+    }
+
+    while (i < set->num_items && j < k)
+    {
+        int cmp = set->cmpfunc(set->array[i], batch[j]);
+
+        if (cmp < 0)
+        {
+            merged[m++] = set->array[i++];
+        }
+        else if (cmp > 0)
+        {
+            merged[m++] = batch[j++];
+        }
+        else
+        {
+            merged[m++] = set->array[i++];
+            j++;
+        }
+    }
+    while (i < set->num_items)
+    {
+        merged[m++] = set->array[i++];
+    }
+    while (j < k)
+    {
+        merged[m++] = batch[j++];
+    }
+
+    free(set->array);
+    free(batch);
+    set->array = merged;
+    set->max_items = set->num_items + k + 1;
+    set->num_items = m;
+    return 1;
+}
+
 /*
  * Returns 1 if the given element is contained in
  * the given set, 0 otherwise.
@@ -169,32 +313,36 @@ set_t *set_union(set_t *a, set_t *b)
  * Returns the intersection of the two given sets; the
  * returned set contains all elements that are contained
  * in both a and b.
+ *
+ * Both sets are sorted first.  Similar sizes are then merged linearly;
+ * when one set is much smaller, its elements are located in the larger
+ * one by galloping, so the cost follows the smaller set.
  */
 set_t *set_intersection(set_t *a, set_t *b)
 {
-   set_t *intersection_set = set_create(a->cmpfunc);
-   
-   set_iter_t *iter_a = set_createiter(a);
-
-   void *item_a = set_next(iter_a);
+    int max = a->num_items < b->num_items ? a->num_items : b->num_items;
+    set_t *intersection_set = set_create(a->cmpfunc);
+    void **elems;
 
-
-    while(item_a != NULL)
+    if (intersection_set == NULL)
     {
-        if (set_contains(b, item_a) == 1)
-        {
-            set_add(intersection_set, item_a);
-        }
-        
-        item_a = set_next(iter_a); 
-
+        return NULL;
+    }
+    elems = malloc((max + 1) * sizeof(void *));
+    if (elems == NULL)
+    {
+        return intersection_set;
     }
-    
-    set_destroyiter(iter_a);
-    
-    
-    return intersection_set; 
 
+    set_sort(a);
+    set_sort(b);
+    free(intersection_set->array);
+    intersection_set->array = elems;
+    intersection_set->max_items = max + 1;
+    intersection_set->num_items = sort_intersect(a->array, a->num_items,
+                                                 b->array, b->num_items,
+                                                 elems, 0, a->cmpfunc);
+    return intersection_set;
 }
 
 /*
@@ -225,6 +373,219 @@ set_t *set_difference(set_t *a, set_t *b)
     return difference_set; 
 }
 
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ */
+void set_intersect_inplace(set_t *a, set_t *b)
+{
+    set_sort(a);
+    set_sort(b);
+    a->num_items = sort_intersect(a->array, a->num_items,
+                                  b->array, b->num_items,
+                                  a->array, 0, a->cmpfunc);
+}
+
+/*
+ * Replaces the contents of a with the union of a and b.
+ */
+void set_union_inplace(set_t *a, set_t *b)
+{
+    set_sort(b);
+    set_add_batch(a, b->array, b->num_items);
+}
+
+/*
+ * Removes from a every element that is contained in b.  Both sets are
+ * sorted, and the array of a is compacted in place during one merge
+ * pass.
+ */
+void set_subtract_inplace(set_t *a, set_t *b)
+{
+    int i = 0, j = 0, n = 0;
+
+    set_sort(a);
+    set_sort(b);
+
+    while (i < a->num_items)
+    {
+        int cmp = j < b->num_items ? a->cmpfunc(a->array[i], b->array[j]) : -1;
+
+        if (cmp > 0)
+        {
+            j++;
+            continue;
+        }
+        if (cmp < 0)
+        {
+            a->array[n++] = a->array[i];
+        }
+        else
+        {
+            j++;
+        }
+        i++;
+    }
+    a->num_items = n;
+}
+
+/*
+ * Returns the intersection of the n given sets.
+ *
+ * All sets are sorted first.  The elements of the smallest set are
+ * then checked against a cursor into each of the other sets, which
+ * only ever moves forward, so the whole intersection is one pass.
+ */
+set_t *set_intersection_many(set_t **sets, int n)
+{
+    set_t *smallest = sets[0];
+    set_t *result = set_create(sets[0]->cmpfunc);
+    int *cursors = calloc(n, sizeof(int));
+    void **elems;
+    int i, j, count = 0, ok;
+
+    for (i = 0; i < n; i++)
+    {
+        set_sort(sets[i]);
+        if (sets[i]->num_items < smallest->num_items)
+        {
+            smallest = sets[i];
+        }
+    }
+
+    elems = malloc((smallest->num_items + 1) * sizeof(void *));
+    if (result == NULL || cursors == NULL || elems == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(cursors);
+        free(elems);
+        return NULL;
+    }
+
+    for (i = 0; i < smallest->num_items; i++)
+    {
+        void *elem = smallest->array[i];
+        int found = 1;
+
+        for (j = 0; j < n && found; j++)
+        {
+            set_t *set = sets[j];
+            int cmp = -1;
+
+            if (set == smallest)
+            {
+                continue;
+            }
+            while (cursors[j] < set->num_items &&
+                   (cmp = set->cmpfunc(set->array[cursors[j]], elem)) < 0)
+            {
+                cursors[j]++;
+            }
+            found = cmp == 0;
+        }
+        if (found)
+        {
+            elems[count++] = elem;
+        }
+    }
+
+    /* The survivors are already sorted, so this is a plain copy */
+    ok = set_add_batch(result, elems, count);
+    free(cursors);
+    free(elems);
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Returns the union of the n given sets, using a k-way heap merge of
+ * their sorted arrays.
+ */
+set_t *set_union_many(set_t **sets, int n)
+{
+    void ***arrays = malloc(n * sizeof(void **));
+    int *sizes = malloc(n * sizeof(int));
+    set_t *result = NULL;
+    void **merged = NULL;
+    int i, total = 0;
+
+    if (arrays != NULL && sizes != NULL)
+    {
+        for (i = 0; i < n; i++)
+        {
+            set_sort(sets[i]);
+            arrays[i] = sets[i]->array;
+            sizes[i] = sets[i]->num_items;
+            total += sizes[i];
+        }
+        merged = malloc((total + 1) * sizeof(void *));
+    }
+
+    if (merged != NULL)
+    {
+        int count = sort_mergeunique(arrays, sizes, n, merged,
+                                     sets[0]->cmpfunc);
+
+        result = count >= 0 ? set_create(sets[0]->cmpfunc) : NULL;
+        if (result != NULL)
+        {
+            free(result->array);
+            result->array = merged;
+            result->max_items = total + 1;
+            result->num_items = count;
+            merged = NULL;
+        }
+    }
+
+    free(merged);
+    free(arrays);
+    free(sizes);
+    return result;
+}
+
+/*
+ * Counts the elements that a and b have in common, merging or
+ * galloping over their sorted arrays depending on their sizes.  If
+ * stop is set, returns as soon as one common element is found.
+ */
+static int countcommon(set_t *a, set_t *b, int stop)
+{
+    set_sort(a);
+    set_sort(b);
+    return sort_intersect(a->array, a->num_items, b->array, b->num_items,
+                          NULL, stop, a->cmpfunc);
+}
+
+/*
+ * Returns the number of elements contained in both a and b.
+ */
+int set_intersection_size(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 0);
+}
+
+/*
+ * Returns the number of elements contained in a and not in b.
+ */
+int set_difference_size(set_t *a, set_t *b)
+{
+    return set_size(a) - countcommon(a, b, 0);
+}
+
+/*
+ * Returns 1 if a and b have at least one element in common.
+ */
+int set_intersects(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 1) > 0;
+}
+
 /*
  * Returns a copy of the given set.
  */
@@ -251,9 +612,13 @@ set_t *set_copy(set_t *set)
 
 /*
  * Creates a new set iterator for iterating over the given set.
+ * The elements are returned in ascending order; the set is only
+ * sorted if it has changed since it was last sorted.
  */
 set_iter_t *set_createiter(set_t *set)
 {
+    set_sort(set);
+
     set_iter_t *set_iter = malloc(sizeof(set_iter_t)); 
     
     if(set_iter == NULL)
@@ -0,0 +1,1640 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "set.h"
+#include "sort.h"
+
+
+/*
+ * A compressed bitmap set, in the style of Roaring bitmaps, for sets
+ * whose elements are 32-bit integers stored as pointers, such as the
+ * word IDs of intern.h.  Elements are always ordered numerically; the
+ * comparison function is kept only so results can carry it along.
+ * Adding an element that does not fit in 32 bits is a fatal error.
+ *
+ * An element x is split into a 16-bit key, x >> 16, and a 16-bit low
+ * part.  All elements with the same key live in one container, which
+ * uses whichever of three encodings is smallest for its contents:
+ *
+ *  - ARRAY:  a sorted array of low parts, for sparse containers
+ *  - BITMAP: 65536 bits, for dense containers
+ *  - RUN:    a sorted array of runs of consecutive values, for
+ *            containers made of long ranges, as dense IDs tend to be
+ *
+ * Operations between two bitmaps (or runs) work a 64-bit word at a
+ * time, in plain loops that compilers vectorize.  Operations involving
+ * a sparse array instead look up each of its values in the other
+ * container.
+ */
+
+#define LOW_BITS 16
+#define LOW_MASK 0xffff
+
+/*
+ * Number of 64-bit words in a bitmap container.
+ */
+#define BITMAP_WORDS 1024
+
+/*
+ * Arrays with more values than this take more room than a bitmap.
+ */
+#define ARRAY_MAX 4096
+
+#define BITMAP_BYTES (BITMAP_WORDS * sizeof(uint64_t))
+
+enum
+{
+    ARRAY,
+    BITMAP,
+    RUN
+};
+
+/*
+ * A run of the consecutive values start to start + length, inclusive.
+ */
+typedef struct run
+{
+    uint16_t start;
+    uint16_t length;
+} run_t;
+
+typedef struct container
+{
+    uint32_t key;       /* The high bits shared by all elements */
+    int type;
+    int card;           /* Number of elements, never 0 in a set */
+    int n;              /* Values (ARRAY) or runs (RUN) used in data */
+    int cap;            /* Values or runs allocated in data */
+    void *data;         /* uint16_t[], uint64_t[] or run_t[] */
+} container_t;
+
+/*
+ * The type of sets.  Containers are kept sorted by key.
+ */
+struct set
+{
+    container_t *containers;
+    int num_containers;
+    int capacity;
+    int num_items;
+    cmpfunc_t cmpfunc;
+};
+
+struct set_iter
+{
+    set_t *set;
+    int current;        /* Index of the current container */
+    int next;           /* Next low part in it, -1 when done */
+};
+
+
+static int popcount64(uint64_t w)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(w);
+#else
+    int n = 0;
+
+    while (w != 0)
+    {
+        w &= w - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Returns the index of the lowest set bit of w, which must not be 0.
+ */
+static int ctz64(uint64_t w)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+
+    while ((w & 1) == 0)
+    {
+        w >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Returns 1 if the given element is a value this implementation can
+ * hold, 0 otherwise.
+ */
+static int fits(void *elem)
+{
+    return (uintptr_t)elem <= UINT32_MAX;
+}
+
+/*
+ * Returns the value of the given element.  Elements that do not fit
+ * in 32 bits are a fatal error, rather than being silently truncated
+ * into some other element.
+ */
+static uint32_t toint(void *elem)
+{
+    if (!fits(elem))
+    {
+        fatal_error("bitmap set element does not fit in 32 bits");
+    }
+    return (uint32_t)(uintptr_t)elem;
+}
+
+static void *toelem(uint32_t key, int low)
+{
+    return (void *)(uintptr_t)((key << LOW_BITS) | (uint32_t)low);
+}
+
+/*
+ * Returns the index of the first of the n sorted values not smaller
+ * than low, or n if there is none.
+ */
+static int arraysearch(uint16_t *vals, int n, int low)
+{
+    int lo = 0, hi = n;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (vals[mid] < low)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Returns the index of the first of the n sorted runs that ends at or
+ * after low, or n if there is none.
+ */
+static int runsearch(run_t *runs, int n, int low)
+{
+    int lo = 0, hi = n;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (runs[mid].start + runs[mid].length < low)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Returns the position of the first set bit (or, if set is 0, the
+ * first clear bit) at or after pos in the given bitmap, or 65536 if
+ * there is none.
+ */
+static int nextbit(uint64_t *words, int pos, int set)
+{
+    int i = pos >> 6;
+    uint64_t w;
+
+    if (pos > LOW_MASK)
+    {
+        return LOW_MASK + 1;
+    }
+    w = (set ? words[i] : ~words[i]) & (~0ULL << (pos & 63));
+    while (w == 0)
+    {
+        if (++i == BITMAP_WORDS)
+        {
+            return LOW_MASK + 1;
+        }
+        w = set ? words[i] : ~words[i];
+    }
+    return i * 64 + ctz64(w);
+}
+
+/*
+ * Sets the bits lo to hi, inclusive, of the given bitmap.
+ */
+static void setrange(uint64_t *words, int lo, int hi)
+{
+    int first = lo >> 6, last = hi >> 6, i;
+    uint64_t firstmask = ~0ULL << (lo & 63);
+    uint64_t lastmask = ~0ULL >> (63 - (hi & 63));
+
+    if (first == last)
+    {
+        words[first] |= firstmask & lastmask;
+        return;
+    }
+    words[first] |= firstmask;
+    for (i = first + 1; i < last; i++)
+    {
+        words[i] = ~0ULL;
+    }
+    words[last] |= lastmask;
+}
+
+static int contains(container_t *c, int low)
+{
+    int i;
+
+    switch (c->type)
+    {
+    case ARRAY:
+        i = arraysearch(c->data, c->n, low);
+        return i < c->n && ((uint16_t *)c->data)[i] == low;
+    case BITMAP:
+        return (((uint64_t *)c->data)[low >> 6] >> (low & 63)) & 1;
+    default:
+        i = runsearch(c->data, c->n, low);
+        return i < c->n && ((run_t *)c->data)[i].start <= low;
+    }
+}
+
+/*
+ * ORs the elements of the given container into the given bitmap.
+ */
+static void orinto(container_t *c, uint64_t *words)
+{
+    uint16_t *vals = c->data;
+    uint64_t *bits = c->data;
+    run_t *runs = c->data;
+    int i;
+
+    switch (c->type)
+    {
+    case ARRAY:
+        for (i = 0; i < c->n; i++)
+        {
+            words[vals[i] >> 6] |= 1ULL << (vals[i] & 63);
+        }
+        break;
+    case BITMAP:
+        for (i = 0; i < BITMAP_WORDS; i++)
+        {
+            words[i] |= bits[i];
+        }
+        break;
+    default:
+        for (i = 0; i < c->n; i++)
+        {
+            setrange(words, runs[i].start, runs[i].start + runs[i].length);
+        }
+        break;
+    }
+}
+
+/*
+ * Returns the bits of the given container, which must not be an array.
+ * A bitmap container returns its own words; a run container is
+ * expanded into tmp.
+ */
+static uint64_t *bitsof(container_t *c, uint64_t *tmp)
+{
+    if (c->type == BITMAP)
+    {
+        return c->data;
+    }
+    memset(tmp, 0, BITMAP_BYTES);
+    orinto(c, tmp);
+    return tmp;
+}
+
+/*
+ * Builds a container of the given key from the n sorted, distinct low
+ * parts in vals, in the smallest encoding.  Returns a container with
+ * card 0 and no data if n is 0 or allocation failed.
+ */
+static container_t fromvalues(uint32_t key, uint16_t *vals, int n)
+{
+    container_t c;
+    int i, k, numruns = n > 0;
+
+    c.key = key;
+    c.card = 0;
+    c.n = 0;
+    c.cap = 0;
+    c.data = NULL;
+    for (i = 1; i < n; i++)
+    {
+        numruns += vals[i] != vals[i - 1] + 1;
+    }
+    if (n == 0)
+    {
+        c.type = ARRAY;
+        return c;
+    }
+
+    if (numruns * sizeof(run_t) < n * sizeof(uint16_t) &&
+        numruns * sizeof(run_t) < BITMAP_BYTES)
+    {
+        run_t *runs = malloc(numruns * sizeof(run_t));
+
+        if (runs == NULL)
+        {
+            return c;
+        }
+        for (i = 0, k = -1; i < n; i++)
+        {
+            if (k >= 0 && vals[i] == runs[k].start + runs[k].length + 1)
+            {
+                runs[k].length++;
+            }
+            else
+            {
+                runs[++k].start = vals[i];
+                runs[k].length = 0;
+            }
+        }
+        c.type = RUN;
+        c.n = c.cap = numruns;
+        c.data = runs;
+    }
+    else if (n <= ARRAY_MAX)
+    {
+        c.data = malloc(n * sizeof(uint16_t));
+        if (c.data == NULL)
+        {
+            return c;
+        }
+        memcpy(c.data, vals, n * sizeof(uint16_t));
+        c.type = ARRAY;
+        c.n = c.cap = n;
+    }
+    else
+    {
+        uint64_t *words = calloc(BITMAP_WORDS, sizeof(uint64_t));
+
+        if (words == NULL)
+        {
+            return c;
+        }
+        for (i = 0; i < n; i++)
+        {
+            words[vals[i] >> 6] |= 1ULL << (vals[i] & 63);
+        }
+        c.type = BITMAP;
+        c.n = c.cap = BITMAP_WORDS;
+        c.data = words;
+    }
+    c.card = n;
+    return c;
+}
+
+/*
+ * Builds a container of the given key from the given bitmap, in the
+ * smallest encoding.  Returns a container with card 0 and no data if
+ * the bitmap is empty or allocation failed.
+ */
+static container_t frombitmap(uint32_t key, uint64_t *words)
+{
+    container_t c;
+    int card = 0, numruns = 0, i, pos;
+    uint64_t carry = 0;
+
+    /* A run starts at every set bit whose lower neighbour is clear */
+    for (i = 0; i < BITMAP_WORDS; i++)
+    {
+        uint64_t w = words[i];
+
+        card += popcount64(w);
+        numruns += popcount64(w & ~((w << 1) | carry));
+        carry = w >> 63;
+    }
+
+    c.key = key;
+    c.card = 0;
+    c.n = 0;
+    c.cap = 0;
+    c.data = NULL;
+    c.type = ARRAY;
+    if (card == 0)
+    {
+        return c;
+    }
+
+    if (numruns * sizeof(run_t) < card * sizeof(uint16_t) &&
+        numruns * sizeof(run_t) < BITMAP_BYTES)
+    {
+        run_t *runs = malloc(numruns * sizeof(run_t));
+
+        if (runs == NULL)
+        {
+            return c;
+        }
+        pos = nextbit(words, 0, 1);
+        for (i = 0; i < numruns; i++)
+        {
+            int end = nextbit(words, pos, 0);
+
+            runs[i].start = pos;
+            runs[i].length = end - 1 - pos;
+            pos = nextbit(words, end, 1);
+        }
+        c.type = RUN;
+        c.n = c.cap = numruns;
+        c.data = runs;
+    }
+    else if (card <= ARRAY_MAX)
+    {
+        uint16_t *vals = malloc(card * sizeof(uint16_t));
+        int k = 0;
+
+        if (vals == NULL)
+        {
+            return c;
+        }
+        for (i = 0; i < BITMAP_WORDS; i++)
+        {
+            uint64_t w = words[i];
+
+            while (w != 0)
+            {
+                vals[k++] = i * 64 + ctz64(w);
+                w &= w - 1;
+            }
+        }
+        c.n = c.cap = card;
+        c.data = vals;
+    }
+    else
+    {
+        c.data = malloc(BITMAP_BYTES);
+        if (c.data == NULL)
+        {
+            return c;
+        }
+        memcpy(c.data, words, BITMAP_BYTES);
+        c.type = BITMAP;
+        c.n = c.cap = BITMAP_WORDS;
+    }
+    c.card = card;
+    return c;
+}
+
+/*
+ * Returns a deep copy of the given container; its card is 0 if
+ * allocation failed.
+ */
+static container_t copycontainer(container_t *c)
+{
+    container_t copy = *c;
+    size_t size;
+
+    if (c->type == ARRAY)
+    {
+        size = c->n * sizeof(uint16_t);
+    }
+    else if (c->type == RUN)
+    {
+        size = c->n * sizeof(run_t);
+    }
+    else
+    {
+        size = BITMAP_BYTES;
+    }
+    copy.cap = c->n;
+    copy.data = malloc(size);
+    if (copy.data == NULL)
+    {
+        copy.card = 0;
+        return copy;
+    }
+    memcpy(copy.data, c->data, size);
+    return copy;
+}
+
+static container_t intersectcontainers(container_t *a, container_t *b)
+{
+    uint64_t tmpa[BITMAP_WORDS], tmpb[BITMAP_WORDS], *x, *y;
+    uint16_t vals[ARRAY_MAX];
+    int i, k = 0;
+
+    if (a->type == ARRAY || b->type == ARRAY)
+    {
+        /* Look up each value of the (smaller) array in the other */
+        container_t *s = a, *o = b;
+
+        if (s->type != ARRAY || (o->type == ARRAY && o->card < s->card))
+        {
+            s = b;
+            o = a;
+        }
+        for (i = 0; i < s->n; i++)
+        {
+            int low = ((uint16_t *)s->data)[i];
+
+            if (contains(o, low))
+            {
+                vals[k++] = low;
+            }
+        }
+        return fromvalues(a->key, vals, k);
+    }
+
+    x = bitsof(a, tmpa);
+    y = bitsof(b, tmpb);
+    for (i = 0; i < BITMAP_WORDS; i++)
+    {
+        tmpa[i] = x[i] & y[i];
+    }
+    return frombitmap(a->key, tmpa);
+}
+
+static container_t unitecontainers(container_t *a, container_t *b)
+{
+    uint64_t words[BITMAP_WORDS];
+
+    if (a->type == ARRAY && b->type == ARRAY && a->card + b->card <= ARRAY_MAX)
+    {
+        uint16_t vals[ARRAY_MAX];
+        uint16_t *va = a->data, *vb = b->data;
+        int i = 0, j = 0, k = 0;
+
+        while (i < a->n && j < b->n)
+        {
+            if (va[i] < vb[j])
+            {
+                vals[k++] = va[i++];
+            }
+            else if (va[i] > vb[j])
+            {
+                vals[k++] = vb[j++];
+            }
+            else
+            {
+                vals[k++] = va[i++];
+                j++;
+            }
+        }
+        while (i < a->n)
+        {
+            vals[k++] = va[i++];
+        }
+        while (j < b->n)
+        {
+            vals[k++] = vb[j++];
+        }
+        return fromvalues(a->key, vals, k);
+    }
+
+    memset(words, 0, BITMAP_BYTES);
+    orinto(a, words);
+    orinto(b, words);
+    return frombitmap(a->key, words);
+}
+
+static container_t subtractcontainers(container_t *a, container_t *b)
+{
+    uint64_t words[BITMAP_WORDS], tmp[BITMAP_WORDS], *y;
+    int i;
+
+    if (a->type == ARRAY)
+    {
+        uint16_t vals[ARRAY_MAX];
+        int k = 0;
+
+        for (i = 0; i < a->n; i++)
+        {
+            int low = ((uint16_t *)a->data)[i];
+
+            if (!contains(b, low))
+            {
+                vals[k++] = low;
+            }
+        }
+        return fromvalues(a->key, vals, k);
+    }
+
+    memset(words, 0, BITMAP_BYTES);
+    orinto(a, words);
+    if (b->type == ARRAY)
+    {
+        uint16_t *vb = b->data;
+
+        for (i = 0; i < b->n; i++)
+        {
+            words[vb[i] >> 6] &= ~(1ULL << (vb[i] & 63));
+        }
+    }
+    else
+    {
+        y = bitsof(b, tmp);
+        for (i = 0; i < BITMAP_WORDS; i++)
+        {
+            words[i] &= ~y[i];
+        }
+    }
+    return frombitmap(a->key, words);
+}
+
+/*
+ * Counts the elements two containers with the same key have in common.
+ * If stop is set, returns as soon as one is found.
+ */
+static int countcontainers(container_t *a, container_t *b, int stop)
+{
+    uint64_t tmpa[BITMAP_WORDS], tmpb[BITMAP_WORDS], *x, *y;
+    int i, count = 0;
+
+    if (a->type == ARRAY || b->type == ARRAY)
+    {
+        container_t *s = a->type == ARRAY ? a : b;
+        container_t *o = s == a ? b : a;
+
+        for (i = 0; i < s->n; i++)
+        {
+            if (contains(o, ((uint16_t *)s->data)[i]))
+            {
+                count++;
+                if (stop)
+                {
+                    break;
+                }
+            }
+        }
+        return count;
+    }
+
+    x = bitsof(a, tmpa);
+    y = bitsof(b, tmpb);
+    for (i = 0; i < BITMAP_WORDS; i++)
+    {
+        count += popcount64(x[i] & y[i]);
+        if (stop && count > 0)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+/*
+ * Adds the given low part to the given container.  Returns 1 if it was
+ * added, and 0 if it was already there or allocation failed.
+ */
+static int addtocontainer(container_t *c, int low)
+{
+    uint64_t words[BITMAP_WORDS];
+    uint16_t *vals = c->data;
+    container_t updated;
+    int i;
+
+    if (contains(c, low))
+    {
+        return 0;
+    }
+
+    if (c->type == BITMAP)
+    {
+        ((uint64_t *)c->data)[low >> 6] |= 1ULL << (low & 63);
+        c->card++;
+        return 1;
+    }
+
+    if (c->type == ARRAY && c->n < ARRAY_MAX)
+    {
+        if (c->n == c->cap)
+        {
+            int cap = c->cap * 2 < ARRAY_MAX ? c->cap * 2 : ARRAY_MAX;
+
+            vals = realloc(c->data, cap * sizeof(uint16_t));
+            if (vals == NULL)
+            {
+                return 0;
+            }
+            c->data = vals;
+            c->cap = cap;
+        }
+        i = arraysearch(vals, c->n, low);
+        memmove(vals + i + 1, vals + i, (c->n - i) * sizeof(uint16_t));
+        vals[i] = low;
+        c->n++;
+        c->card++;
+        return 1;
+    }
+
+    /* A full array or a run container: re-encode through a bitmap.
+     * Run containers come from bulk operations, so this is rare. */
+    memset(words, 0, BITMAP_BYTES);
+    orinto(c, words);
+    words[low >> 6] |= 1ULL << (low & 63);
+    updated = frombitmap(c->key, words);
+    if (updated.card == 0)
+    {
+        return 0;
+    }
+    free(c->data);
+    *c = updated;
+    return 1;
+}
+
+/*
+ * Returns the smallest low part in the given container that is not
+ * smaller than low, or -1 if there is none.
+ */
+static int nextfrom(container_t *c, int low)
+{
+    int i;
+
+    if (low > LOW_MASK)
+    {
+        return -1;
+    }
+    switch (c->type)
+    {
+    case ARRAY:
+        i = arraysearch(c->data, c->n, low);
+        return i < c->n ? ((uint16_t *)c->data)[i] : -1;
+    case BITMAP:
+        i = nextbit(c->data, low, 1);
+        return i <= LOW_MASK ? i : -1;
+    default:
+        i = runsearch(c->data, c->n, low);
+        if (i == c->n)
+        {
+            return -1;
+        }
+        return ((run_t *)c->data)[i].start > low ?
+            ((run_t *)c->data)[i].start : low;
+    }
+}
+
+/*
+ * Returns the index of the first container of the given set whose key
+ * is not smaller than key, or the number of containers if none is.
+ */
+static int findcontainer(set_t *set, uint32_t key)
+{
+    int lo = 0, hi = set->num_containers;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (set->containers[mid].key < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Makes room for at least capacity containers in the given set.
+ * Returns 1 on success, and 0 if allocation failed.
+ */
+static int reserve(set_t *set, int capacity)
+{
+    container_t *containers;
+
+    if (capacity <= set->capacity)
+    {
+        return 1;
+    }
+    if (capacity < set->capacity * 2)
+    {
+        capacity = set->capacity * 2;
+    }
+    containers = realloc(set->containers, capacity * sizeof(container_t));
+    if (containers == NULL)
+    {
+        return 0;
+    }
+    set->containers = containers;
+    set->capacity = capacity;
+    return 1;
+}
+
+/*
+ * Appends the given container to the given set, whose containers must
+ * all have smaller keys.  Empty containers are dropped.
+ */
+static void append(set_t *set, container_t c)
+{
+    if (c.card == 0)
+    {
+        free(c.data);
+        return;
+    }
+    if (!reserve(set, set->num_containers + 1))
+    {
+        free(c.data);
+        return;
+    }
+    set->containers[set->num_containers++] = c;
+    set->num_items += c.card;
+}
+
+static void freecontainers(set_t *set)
+{
+    int i;
+
+    for (i = 0; i < set->num_containers; i++)
+    {
+        free(set->containers[i].data);
+    }
+}
+
+/*
+ * Creates a new, empty set with room for the given number of
+ * containers.
+ */
+static set_t *createsized(cmpfunc_t cmpfunc, int capacity)
+{
+    set_t *set = malloc(sizeof(set_t));
+
+    if (set == NULL)
+    {
+        return NULL;
+    }
+    if (capacity < 1)
+    {
+        capacity = 1;
+    }
+    set->containers = malloc(capacity * sizeof(container_t));
+    if (set->containers == NULL)
+    {
+        free(set);
+        return NULL;
+    }
+    set->num_containers = 0;
+    set->capacity = capacity;
+    set->num_items = 0;
+    set->cmpfunc = cmpfunc;
+    return set;
+}
+
+/*
+ * Creates a new set using the given comparison function
+ * to compare elements of the set.
+ */
+set_t *set_create(cmpfunc_t cmpfunc)
+{
+    return createsized(cmpfunc, 4);
+}
+
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set.  This implementation does not hash its
+ * elements, so the hash function is ignored.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc)
+{
+    return set_create(cmpfunc);
+}
+
+/*
+ * Numeric comparison of elements, which is the order this
+ * implementation keeps regardless of the set's comparison function.
+ */
+static int compare_elems(void *a, void *b)
+{
+    uint32_t x = toint(a), y = toint(b);
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Creates a new set using the given comparison function, holding the
+ * n elements of the given array.  Duplicates are dropped.  The array
+ * itself is not modified.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    set_t *set = set_create(cmpfunc);
+    void **sorted;
+    uint16_t *vals;
+    int i, j, ok = 1;
+
+    if (set == NULL || n == 0)
+    {
+        return set;
+    }
+    sorted = malloc(n * sizeof(void *));
+    vals = malloc((n < LOW_MASK + 1 ? n : LOW_MASK + 1) * sizeof(uint16_t));
+    if (sorted == NULL || vals == NULL)
+    {
+        free(sorted);
+        free(vals);
+        set_destroy(set);
+        return NULL;
+    }
+    memcpy(sorted, elems, n * sizeof(void *));
+    n = sort_unique(sorted, n, compare_elems);
+
+    /* Each group of elements sharing a key becomes one container */
+    for (i = 0; i < n && ok; i = j)
+    {
+        uint32_t key = toint(sorted[i]) >> LOW_BITS;
+        container_t c;
+
+        for (j = i; j < n && toint(sorted[j]) >> LOW_BITS == key; j++)
+        {
+            vals[j - i] = toint(sorted[j]) & LOW_MASK;
+        }
+        c = fromvalues(key, vals, j - i);
+        ok = c.card != 0 && reserve(set, set->num_containers + 1);
+        append(set, c);
+    }
+    free(sorted);
+    free(vals);
+    if (!ok)
+    {
+        set_destroy(set);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Creates a new set using the given comparison function, holding the
+ * elements of the given list.  Duplicates are dropped.  The list itself
+ * is not modified.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list)
+{
+    int n = list_size(list);
+    void **elems = malloc((n + 1) * sizeof(void *));
+    list_iter_t *iter;
+    set_t *set;
+    int i = 0;
+
+    if (elems == NULL)
+    {
+        return NULL;
+    }
+    iter = list_createiter(list);
+    while (list_hasnext(iter))
+    {
+        elems[i++] = list_next(iter);
+    }
+    list_destroyiter(iter);
+
+    set = set_create_from_array(cmpfunc, elems, n);
+    free(elems);
+    return set;
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  This
+ * implementation does not hash its elements, so the hash function is
+ * ignored.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n)
+{
+    return set_create_from_array(cmpfunc, elems, n);
+}
+
+/*
+ * Creates a new set holding the elements of the given list, ignoring
+ * the hash function as above.
+ */
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list)
+{
+    return set_create_from_list(cmpfunc, list);
+}
+
+/*
+ * Destroys the given set.  Subsequently accessing the set
+ * will lead to undefined behavior.
+ */
+void set_destroy(set_t *set)
+{
+    freecontainers(set);
+    free(set->containers);
+    free(set);
+}
+
+/*
+ * Returns the size (cardinality) of the given set.
+ */
+int set_size(set_t *set)
+{
+    return set->num_items;
+}
+
+/*
+ * Adds the given element to the given set.
+ */
+void set_add(set_t *set, void *elem)
+{
+    uint32_t x = toint(elem);
+    uint32_t key = x >> LOW_BITS;
+    int i = findcontainer(set, key);
+
+    if (i == set->num_containers || set->containers[i].key != key)
+    {
+        uint16_t low = x & LOW_MASK;
+        container_t c = fromvalues(key, &low, 1);
+
+        if (c.card == 0 || !reserve(set, set->num_containers + 1))
+        {
+            free(c.data);
+            return;
+        }
+        memmove(set->containers + i + 1, set->containers + i,
+                (set->num_containers - i) * sizeof(container_t));
+        set->containers[i] = c;
+        set->num_containers++;
+        set->num_items++;
+        return;
+    }
+    set->num_items += addtocontainer(&set->containers[i], x & LOW_MASK);
+}
+
+/*
+ * Replaces the contents of a with the union of a and b, reusing the
+ * storage of a.  Containers found only in a are kept as they are.
+ * Returns 1 on success, and 0 if allocation failed; the containers of
+ * a that could not be grown are then kept as they were.
+ */
+static int uniteinto(set_t *a, set_t *b)
+{
+    container_t *old = a->containers;
+    int na = a->num_containers, i = 0, j = 0, ok = 1;
+
+    if (a == b || b->num_containers == 0)
+    {
+        return 1;
+    }
+    a->containers = malloc((na + b->num_containers) * sizeof(container_t));
+    if (a->containers == NULL)
+    {
+        a->containers = old;
+        return 0;
+    }
+    a->num_containers = 0;
+    a->capacity = na + b->num_containers;
+    a->num_items = 0;
+
+    while (i < na || j < b->num_containers)
+    {
+        if (j == b->num_containers ||
+            (i < na && old[i].key < b->containers[j].key))
+        {
+            append(a, old[i++]);
+        }
+        else if (i == na || b->containers[j].key < old[i].key)
+        {
+            container_t c = copycontainer(&b->containers[j++]);
+
+            ok = ok && c.card != 0;
+            append(a, c);
+        }
+        else
+        {
+            container_t r = unitecontainers(&old[i], &b->containers[j++]);
+
+            if (r.card == 0)
+            {
+                /* Out of memory; keep what a had */
+                append(a, old[i++]);
+                ok = 0;
+            }
+            else
+            {
+                free(old[i++].data);
+                append(a, r);
+            }
+        }
+    }
+    free(old);
+    return ok;
+}
+
+/*
+ * Adds the n elements of the given array to the given set.  The array
+ * itself is not modified.  The batch is built into containers of its
+ * own, which are then united with those of the set.
+ */
+int set_add_batch(set_t *set, void **elems, int n)
+{
+    set_t *batch;
+    int ok;
+
+    if (n == 0)
+    {
+        return 1;
+    }
+    batch = set_create_from_array(set->cmpfunc, elems, n);
+    if (batch == NULL)
+    {
+        return 0;
+    }
+    ok = uniteinto(set, batch);
+    set_destroy(batch);
+    return ok;
+}
+
+/*
+ * Returns 1 if the given element is contained in
+ * the given set, 0 otherwise.
+ */
+int set_contains(set_t *set, void *elem)
+{
+    uint32_t x;
+    int i;
+
+    /* A value that cannot be added is simply not there */
+    if (!fits(elem))
+    {
+        return 0;
+    }
+    x = toint(elem);
+    i = findcontainer(set, x >> LOW_BITS);
+    return i < set->num_containers &&
+        set->containers[i].key == x >> LOW_BITS &&
+        contains(&set->containers[i], x & LOW_MASK);
+}
+
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ */
+set_t *set_union(set_t *a, set_t *b)
+{
+    set_t *result = createsized(a->cmpfunc,
+                                a->num_containers + b->num_containers);
+    int i = 0, j = 0;
+
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    while (i < a->num_containers || j < b->num_containers)
+    {
+        if (j == b->num_containers ||
+            (i < a->num_containers &&
+             a->containers[i].key < b->containers[j].key))
+        {
+            append(result, copycontainer(&a->containers[i++]));
+        }
+        else if (i == a->num_containers ||
+                 b->containers[j].key < a->containers[i].key)
+        {
+            append(result, copycontainer(&b->containers[j++]));
+        }
+        else
+        {
+            append(result, unitecontainers(&a->containers[i++],
+                                           &b->containers[j++]));
+        }
+    }
+    return result;
+}
+
+/*
+ * Returns the intersection of the two given sets; the
+ * returned set contains all elements that are contained
+ * in both a and b.
+ */
+set_t *set_intersection(set_t *a, set_t *b)
+{
+    set_t *result = set_create(a->cmpfunc);
+    int i = 0, j = 0;
+
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    while (i < a->num_containers && j < b->num_containers)
+    {
+        if (a->containers[i].key < b->containers[j].key)
+        {
+            i++;
+        }
+        else if (a->containers[i].key > b->containers[j].key)
+        {
+            j++;
+        }
+        else
+        {
+            append(result, intersectcontainers(&a->containers[i++],
+                                               &b->containers[j++]));
+        }
+    }
+    return result;
+}
+
+/*
+ * Returns the set difference of the two given sets; the
+ * returned set contains all elements that are contained
+ * in a and not in b.
+ */
+set_t *set_difference(set_t *a, set_t *b)
+{
+    set_t *result = createsized(a->cmpfunc, a->num_containers);
+    int i = 0, j = 0;
+
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    while (i < a->num_containers)
+    {
+        while (j < b->num_containers &&
+               b->containers[j].key < a->containers[i].key)
+        {
+            j++;
+        }
+        if (j < b->num_containers &&
+            b->containers[j].key == a->containers[i].key)
+        {
+            append(result, subtractcontainers(&a->containers[i++],
+                                              &b->containers[j++]));
+        }
+        else
+        {
+            append(result, copycontainer(&a->containers[i++]));
+        }
+    }
+    return result;
+}
+
+/*
+ * Replaces the contents of a with the intersection of a and b, reusing
+ * the storage of a.  Returns 1 on success, and 0 if allocation failed;
+ * the containers that could not be intersected are then dropped.
+ */
+static int intersectinto(set_t *a, set_t *b)
+{
+    int i, j = 0, k = 0, ok = 1;
+
+    if (a == b)
+    {
+        return 1;
+    }
+    a->num_items = 0;
+    for (i = 0; i < a->num_containers; i++)
+    {
+        container_t *c = &a->containers[i];
+
+        while (j < b->num_containers && b->containers[j].key < c->key)
+        {
+            j++;
+        }
+        if (j < b->num_containers && b->containers[j].key == c->key)
+        {
+            container_t r = intersectcontainers(c, &b->containers[j]);
+
+            /* An empty result is only an error if the two overlap */
+            if (r.card == 0 && countcontainers(c, &b->containers[j], 1) > 0)
+            {
+                ok = 0;
+            }
+            free(c->data);
+            if (r.card > 0)
+            {
+                a->containers[k++] = r;
+                a->num_items += r.card;
+            }
+        }
+        else
+        {
+            free(c->data);
+        }
+    }
+    a->num_containers = k;
+    return ok;
+}
+
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ * Unlike set_intersection, no new set is allocated; the storage
+ * of a is reused.
+ */
+void set_intersect_inplace(set_t *a, set_t *b)
+{
+    intersectinto(a, b);
+}
+
+/*
+ * Replaces the contents of a with the union of a and b (see uniteinto).
+ */
+void set_union_inplace(set_t *a, set_t *b)
+{
+    uniteinto(a, b);
+}
+
+/*
+ * Removes from a every element that is contained in b, reusing
+ * the storage of a.
+ */
+void set_subtract_inplace(set_t *a, set_t *b)
+{
+    int i, j = 0, k = 0;
+
+    if (a == b)
+    {
+        freecontainers(a);
+        a->num_containers = 0;
+        a->num_items = 0;
+        return;
+    }
+    a->num_items = 0;
+    for (i = 0; i < a->num_containers; i++)
+    {
+        container_t c = a->containers[i];
+
+        while (j < b->num_containers && b->containers[j].key < c.key)
+        {
+            j++;
+        }
+        if (j < b->num_containers && b->containers[j].key == c.key)
+        {
+            container_t r = subtractcontainers(&c, &b->containers[j]);
+
+            free(c.data);
+            c = r;
+        }
+        if (c.card > 0)
+        {
+            a->containers[k++] = c;
+            a->num_items += c.card;
+        }
+    }
+    a->num_containers = k;
+}
+
+/*
+ * Returns the intersection of the n given sets.  Starts from a copy of
+ * the smallest set and intersects it in place with each of the others,
+ * so the work per set is bounded by the shrinking result.
+ */
+set_t *set_intersection_many(set_t **sets, int n)
+{
+    set_t *result;
+    int i, smallest = 0, ok = 1;
+
+    for (i = 1; i < n; i++)
+    {
+        if (sets[i]->num_items < sets[smallest]->num_items)
+        {
+            smallest = i;
+        }
+    }
+    result = set_copy(sets[smallest]);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    result->cmpfunc = sets[0]->cmpfunc;
+    for (i = 0; i < n && ok && result->num_items > 0; i++)
+    {
+        if (i != smallest)
+        {
+            ok = intersectinto(result, sets[i]);
+        }
+    }
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Orders pointers to containers by key.
+ */
+static int compare_keys(void *a, void *b)
+{
+    uint32_t x = ((container_t *)a)->key, y = ((container_t *)b)->key;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Returns the union of the n given sets.  All containers are gathered
+ * and grouped by key; each group is ORed into a single bitmap and
+ * re-encoded once, so every input container is read exactly once.
+ */
+set_t *set_union_many(set_t **sets, int n)
+{
+    uint64_t words[BITMAP_WORDS];
+    container_t **all;
+    set_t *result;
+    int i, j, k, total = 0, ok = 1;
+
+    for (i = 0; i < n; i++)
+    {
+        total += sets[i]->num_containers;
+    }
+    result = createsized(sets[0]->cmpfunc, total);
+    all = malloc((total + 1) * sizeof(container_t *));
+    if (result == NULL || all == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(all);
+        return NULL;
+    }
+    for (i = 0, k = 0; i < n; i++)
+    {
+        for (j = 0; j < sets[i]->num_containers; j++)
+        {
+            all[k++] = &sets[i]->containers[j];
+        }
+    }
+    sort_array((void **)all, total, compare_keys);
+
+    /* Containers are never empty, so an empty one means out of memory */
+    for (i = 0; i < total && ok; i = j)
+    {
+        container_t c;
+
+        for (j = i + 1; j < total && all[j]->key == all[i]->key; j++)
+            ;
+        if (j - i == 1)
+        {
+            c = copycontainer(all[i]);
+        }
+        else
+        {
+            memset(words, 0, BITMAP_BYTES);
+            for (k = i; k < j; k++)
+            {
+                orinto(all[k], words);
+            }
+            c = frombitmap(all[i]->key, words);
+        }
+        ok = c.card != 0;
+        append(result, c);
+    }
+    free(all);
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Counts the elements that a and b have in common, container by
+ * container.  If stop is set, returns as soon as one is found.
+ */
+static int countcommon(set_t *a, set_t *b, int stop)
+{
+    int i = 0, j = 0, count = 0;
+
+    while (i < a->num_containers && j < b->num_containers)
+    {
+        if (a->containers[i].key < b->containers[j].key)
+        {
+            i++;
+        }
+        else if (a->containers[i].key > b->containers[j].key)
+        {
+            j++;
+        }
+        else
+        {
+            count += countcontainers(&a->containers[i++],
+                                     &b->containers[j++], stop);
+            if (stop && count > 0)
+            {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/*
+ * Returns the number of elements contained in both a and b, without
+ * building the intersection.
+ */
+int set_intersection_size(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 0);
+}
+
+/*
+ * Returns the number of elements contained in a and not in b, without
+ * building the difference.
+ */
+int set_difference_size(set_t *a, set_t *b)
+{
+    return a->num_items - countcommon(a, b, 0);
+}
+
+/*
+ * Returns 1 if a and b have at least one element in common, 0
+ * otherwise.  Stops at the first common element found.
+ */
+int set_intersects(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 1) > 0;
+}
+
+/*
+ * Returns a copy of the given set.
+ */
+set_t *set_copy(set_t *set)
+{
+    set_t *copy = createsized(set->cmpfunc, set->num_containers);
+    int i;
+
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < set->num_containers; i++)
+    {
+        container_t c = copycontainer(&set->containers[i]);
+
+        if (c.card == 0)
+        {
+            set_destroy(copy);
+            return NULL;
+        }
+        append(copy, c);
+    }
+    return copy;
+}
+
+/*
+ * Creates a new set iterator for iterating over the given set.
+ * Elements are returned in ascending numeric order.
+ */
+set_iter_t *set_createiter(set_t *set)
+{
+    set_iter_t *iter = malloc(sizeof(set_iter_t));
+
+    if (iter == NULL)
+    {
+        return NULL;
+    }
+    iter->set = set;
+    iter->current = 0;
+    iter->next = set->num_containers > 0 ?
+        nextfrom(&set->containers[0], 0) : -1;
+    return iter;
+}
+
+/*
+ * Destroys the given set iterator.
+ */
+void set_destroyiter(set_iter_t *iter)
+{
+    free(iter);
+}
+
+/*
+ * Returns 0 if the given set iterator has reached the end of the
+ * set, or 1 otherwise.
+ */
+int set_hasnext(set_iter_t *iter)
+{
+    return iter->current < iter->set->num_containers;
+}
+
+/*
+ * Returns the next element in the sequence represented by the given
+ * set iterator.
+ */
+void *set_next(set_iter_t *iter)
+{
+    set_t *set = iter->set;
+    container_t *c;
+    void *elem;
+
+    if (iter->current >= set->num_containers)
+    {
+        return NULL;
+    }
+    c = &set->containers[iter->current];
+    elem = toelem(c->key, iter->next);
+
+    iter->next = nextfrom(c, iter->next + 1);
+    if (iter->next < 0 && ++iter->current < set->num_containers)
+    {
+        iter->next = nextfrom(&set->containers[iter->current], 0);
+    }
+    return elem;
+}
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "bloom.h"
+
+
+/*
+ * Bits per word added.  Together with BLOOM_BLOCK, this sets the rate
+ * of false positives.
+ */
+#define BITS_PER_WORD 16
+
+/*
+ * Alignment of the blocks of a filter: a cache line, which holds two
+ * blocks.  malloc only aligns to 16 bytes.
+ */
+#define BLOCK_ALIGN 64
+
+/*
+ * Odd multipliers that spread the low half of a hash into one bit
+ * position for each word of a block.
+ */
+static const uint32_t salts[BLOOM_BLOCK] =
+{
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+uint32_t bloom_blocks(int n)
+{
+    uint64_t bits = (uint64_t)n * BITS_PER_WORD;
+    uint64_t nblocks = (bits + BLOOM_BLOCK * 32 - 1) / (BLOOM_BLOCK * 32);
+
+    return nblocks > 0 ? nblocks : 1;
+}
+
+bloom_t *bloom_create(int n)
+{
+    bloom_t *bloom = malloc(sizeof(bloom_t));
+    size_t size;
+    void *blocks;
+    int err;
+
+    if (bloom == NULL)
+    {
+        return NULL;
+    }
+    bloom->nblocks = bloom_blocks(n);
+    size = (size_t)bloom->nblocks * BLOOM_BLOCK * sizeof(uint32_t);
+    err = posix_memalign(&blocks, BLOCK_ALIGN, size);
+    if (err != 0)
+    {
+        free(bloom);
+        errno = err;
+        return NULL;
+    }
+    memset(blocks, 0, size);
+    bloom->blocks = blocks;
+    return bloom;
+}
+
+void bloom_destroy(bloom_t *bloom)
+{
+    free(bloom->blocks);
+    free(bloom);
+}
+
+/*
+ * 64-bit FNV-1a, with a final mix so that both halves are usable.
+ */
+uint64_t bloom_hash(char *word, int len)
+{
+    unsigned char *s = (unsigned char *)word;
+    uint64_t h = 14695981039346656037ULL;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= s[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * Returns the block for the given hash, picked by its high half
+ * without a division.
+ */
+static uint32_t *findblock(bloom_t *bloom, uint64_t hash)
+{
+    uint64_t i = ((hash >> 32) * bloom->nblocks) >> 32;
+
+    return bloom->blocks + i * BLOOM_BLOCK;
+}
+
+void bloom_add(bloom_t *bloom, uint64_t hash)
+{
+    uint32_t *block = findblock(bloom, hash);
+    uint32_t key = (uint32_t)hash;
+    int i;
+
+    for (i = 0; i < BLOOM_BLOCK; i++)
+    {
+        block[i] |= 1U << ((key * salts[i]) >> 27);
+    }
+}
+
+int bloom_check(bloom_t *bloom, uint64_t hash)
+{
+    uint32_t *block = findblock(bloom, hash);
+    uint32_t key = (uint32_t)hash;
+    uint32_t missing = 0;
+    int i;
+
+    /* No early exit, so the loop has no branches to mispredict */
+    for (i = 0; i < BLOOM_BLOCK; i++)
+    {
+        missing |= ~block[i] & (1U << ((key * salts[i]) >> 27));
+    }
+    return missing == 0;
+}
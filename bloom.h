@@ -0,0 +1,65 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+
+/*
+ * Blocked Bloom filters over words.  A filter is an array of blocks of
+ * BLOOM_BLOCK 32-bit words, and each word added sets one bit in each
+ * of the words of a single block, chosen by its hash.  Checking a word
+ * thus touches one block, which lies within one cache line if the
+ * array is aligned, however big the filter is.
+ *
+ * A filter never says that a word it holds is missing, but it may say
+ * that a missing word is there.  With the number of blocks given by
+ * bloom_blocks, that happens for about 0.15% of missing words.
+ */
+#define BLOOM_BLOCK 8
+
+/*
+ * A filter, as a view of its blocks.  A filter from bloom_create owns
+ * its blocks; otherwise they are owned elsewhere, so a filter may live
+ * in a mapped file (see model.h).
+ */
+typedef struct bloom
+{
+    uint32_t *blocks;       /* nblocks * BLOOM_BLOCK words */
+    uint32_t nblocks;
+} bloom_t;
+
+/*
+ * Returns the number of blocks of a filter for n words.
+ */
+uint32_t bloom_blocks(int n);
+
+/*
+ * Creates an empty filter for n words, with bloom_blocks(n) blocks
+ * aligned to a cache line, so that no block straddles two lines.
+ * Returns NULL, with errno set, if allocation failed.
+ */
+bloom_t *bloom_create(int n);
+
+/*
+ * Destroys a filter from bloom_create, and its blocks.
+ */
+void bloom_destroy(bloom_t *bloom);
+
+/*
+ * Returns the hash of the len characters at word, for bloom_add and
+ * bloom_check.  Words are hashed as they are, so they should already
+ * be lowercase.
+ */
+uint64_t bloom_hash(char *word, int len);
+
+/*
+ * Adds the word with the given hash to the filter.
+ */
+void bloom_add(bloom_t *bloom, uint64_t hash);
+
+/*
+ * Returns 0 if the word with the given hash is certainly not in the
+ * filter, and 1 if it may be.
+ */
+int bloom_check(bloom_t *bloom, uint64_t hash);
+
+#endif
@@ -0,0 +1,786 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "set.h"
+
+
+/*
+ * Initial number of slots.  Must be a power of two.
+ */
+#define INITIAL_SLOTS 16
+
+/*
+ * The table is grown when it is more than half full, which keeps the
+ * expected length of a linear probe sequence short.
+ */
+#define MAX_LOAD(nslots) ((nslots) / 2)
+
+/*
+ * The type of sets.
+ *
+ * Elements are stored in an open addressed table with linear probing.
+ * The hash of each element is cached next to it, so that growing the
+ * table and skipping non-matching slots never calls the hash or
+ * comparison functions.  Elements are never NULL, so NULL marks an
+ * empty slot.
+ */
+struct set
+{
+    void **slots;
+    unsigned long *hashes;
+    int num_slots;
+    int num_items;
+    cmpfunc_t cmpfunc;
+    hashfunc_t hashfunc;
+};
+
+struct set_iter
+{
+    set_t *set;
+    int current;
+};
+
+/*
+ * Spreads the bits of a hash value so that hash functions with weak
+ * low bits still use the whole table.
+ */
+static unsigned long mixhash(unsigned long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * Returns the hash that target uses for the element in slot i of
+ * source.  Sets created with different hash functions may be combined,
+ * so the hash cached in source is only reused if both sets use the
+ * same function.
+ */
+static unsigned long hashfor(set_t *target, set_t *source, int i)
+{
+    if (target->hashfunc == source->hashfunc)
+    {
+        return source->hashes[i];
+    }
+    return mixhash(target->hashfunc(source->slots[i]));
+}
+
+/*
+ * Allocates the slot and hash arrays of the given set for num_slots
+ * slots.  Returns 1 on success, and 0 if the allocation failed.
+ */
+static int allocslots(set_t *set, int num_slots)
+{
+    set->slots = calloc(num_slots, sizeof(void *));
+    set->hashes = malloc(num_slots * sizeof(unsigned long));
+    if (set->slots == NULL || set->hashes == NULL)
+    {
+        free(set->slots);
+        free(set->hashes);
+        return 0;
+    }
+    set->num_slots = num_slots;
+    return 1;
+}
+
+/*
+ * Returns the slot holding an element equal to elem, or the empty
+ * slot where it would be inserted.
+ */
+static int findslot(set_t *set, void *elem, unsigned long h)
+{
+    int mask = set->num_slots - 1;
+    int i = h & mask;
+
+    while (set->slots[i] != NULL)
+    {
+        if (set->hashes[i] == h && set->cmpfunc(set->slots[i], elem) == 0)
+        {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * Moves all elements into a table with num_slots slots.
+ */
+static void resize(set_t *set, int num_slots)
+{
+    void **old_slots = set->slots;
+    unsigned long *old_hashes = set->hashes;
+    int old_num_slots = set->num_slots;
+    int i;
+
+    if (!allocslots(set, num_slots))
+    {
+        /* Keep the old table; it is still valid, only fuller */
+        set->slots = old_slots;
+        set->hashes = old_hashes;
+        return;
+    }
+
+    for (i = 0; i < old_num_slots; i++)
+    {
+        if (old_slots[i] != NULL)
+        {
+            int mask = num_slots - 1;
+            int j = old_hashes[i] & mask;
+
+            while (set->slots[j] != NULL)
+            {
+                j = (j + 1) & mask;
+            }
+            set->slots[j] = old_slots[i];
+            set->hashes[j] = old_hashes[i];
+        }
+    }
+    free(old_slots);
+    free(old_hashes);
+}
+
+/*
+ * Empties slot i of the given set.  Later elements of the same probe
+ * run are shifted back into the hole (backward-shift deletion), so
+ * lookups never need tombstones.
+ */
+static void removeslot(set_t *set, int i)
+{
+    int mask = set->num_slots - 1;
+    int j = i;
+
+    for (;;)
+    {
+        set->slots[i] = NULL;
+        for (;;)
+        {
+            int home;
+
+            j = (j + 1) & mask;
+            if (set->slots[j] == NULL)
+            {
+                return;
+            }
+            /* An element whose home slot lies cyclically in (i, j]
+             * is still reachable, and stays where it is */
+            home = set->hashes[j] & mask;
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            {
+                continue;
+            }
+            break;
+        }
+        set->slots[i] = set->slots[j];
+        set->hashes[i] = set->hashes[j];
+        i = j;
+    }
+}
+
+/*
+ * Grows the table of the given set until it can hold num_items
+ * elements without exceeding the maximum load.
+ */
+static void reserve(set_t *set, int num_items)
+{
+    int num_slots = set->num_slots;
+
+    while (num_items > MAX_LOAD(num_slots))
+    {
+        num_slots *= 2;
+    }
+    if (num_slots != set->num_slots)
+    {
+        resize(set, num_slots);
+    }
+}
+
+/*
+ * Inserts elem with the precomputed hash h, unless an equal
+ * element is already present.
+ */
+static void addhashed(set_t *set, void *elem, unsigned long h)
+{
+    int i;
+
+    if (set->num_items + 1 > MAX_LOAD(set->num_slots))
+    {
+        resize(set, set->num_slots * 2);
+    }
+
+    i = findslot(set, elem, h);
+    if (set->slots[i] == NULL)
+    {
+        set->slots[i] = elem;
+        set->hashes[i] = h;
+        set->num_items++;
+    }
+}
+
+/*
+ * Creates a new set using the given comparison function
+ * to compare elements of the set.
+ *
+ * Nothing about the elements can be hashed from a comparison function
+ * alone, and without a hash every element would share one probe
+ * sequence, making each operation a linear scan.  So this is an error
+ * here; use set_createhash.
+ */
+set_t *set_create(cmpfunc_t cmpfunc)
+{
+    return set_createhash(cmpfunc, NULL);
+}
+
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set, and the given hash function to hash them.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc)
+{
+    set_t *set;
+
+    if (hashfunc == NULL)
+    {
+        fatal_error("hash set created without a hash function");
+    }
+    set = malloc(sizeof(set_t));
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    if (!allocslots(set, INITIAL_SLOTS))
+    {
+        free(set);
+        return NULL;
+    }
+    set->num_items = 0;
+    set->cmpfunc = cmpfunc;
+    set->hashfunc = hashfunc;
+    return set;
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  Like
+ * set_create, this needs a hash function it is not given, so it is an
+ * error; use set_createhash_from_array.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    return set_createhash_from_array(cmpfunc, NULL, elems, n);
+}
+
+/*
+ * Creates a new set holding the elements of the given list, which is
+ * an error as above; use set_createhash_from_list.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list)
+{
+    return set_createhash_from_list(cmpfunc, NULL, list);
+}
+
+/*
+ * Creates a new set holding the n elements of the given array, hashed
+ * with the given hash function.  The table is sized for all of them
+ * up front.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n)
+{
+    set_t *set = set_createhash(cmpfunc, hashfunc);
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    set_add_batch(set, elems, n);
+    return set;
+}
+
+/*
+ * Creates a new set holding the elements of the given list, hashed
+ * with the given hash function.
+ */
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list)
+{
+    set_t *set = set_createhash(cmpfunc, hashfunc);
+    list_iter_t *iter;
+
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    reserve(set, list_size(list));
+    iter = list_createiter(list);
+    while (list_hasnext(iter))
+    {
+        set_add(set, list_next(iter));
+    }
+    list_destroyiter(iter);
+    return set;
+}
+
+/*
+ * Destroys the given set.  Subsequently accessing the set
+ * will lead to undefined behavior.
+ */
+void set_destroy(set_t *set)
+{
+    free(set->slots);
+    free(set->hashes);
+    free(set);
+}
+
+/*
+ * Returns the size (cardinality) of the given set.
+ */
+int set_size(set_t *set)
+{
+    return set->num_items;
+}
+
+/*
+ * Adds the given element to the given set.
+ */
+void set_add(set_t *set, void *elem)
+{
+    addhashed(set, elem, mixhash(set->hashfunc(elem)));
+}
+
+/*
+ * Adds the n elements of the given array to the given set.  Hashing
+ * needs no sort step; the table is grown once up front so that the
+ * batch is inserted without intermediate resizes.  Growing up front
+ * is only a shortcut, so its failure is not reported; the elements
+ * are added as set_add would add them.
+ */
+int set_add_batch(set_t *set, void **elems, int n)
+{
+    int i;
+
+    reserve(set, set->num_items + n);
+    for (i = 0; i < n; i++)
+    {
+        set_add(set, elems[i]);
+    }
+    return 1;
+}
+
+/*
+ * Returns 1 if the given element is contained in
+ * the given set, 0 otherwise.
+ */
+int set_contains(set_t *set, void *elem)
+{
+    int i = findslot(set, elem, mixhash(set->hashfunc(elem)));
+
+    return set->slots[i] != NULL;
+}
+
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ */
+set_t *set_union(set_t *a, set_t *b)
+{
+    set_t *union_set = set_createhash(a->cmpfunc, a->hashfunc);
+    int i;
+
+    if (union_set == NULL)
+    {
+        return NULL;
+    }
+    reserve(union_set, a->num_items + b->num_items);
+
+    for (i = 0; i < a->num_slots; i++)
+    {
+        if (a->slots[i] != NULL)
+        {
+            addhashed(union_set, a->slots[i], hashfor(union_set, a, i));
+        }
+    }
+    for (i = 0; i < b->num_slots; i++)
+    {
+        if (b->slots[i] != NULL)
+        {
+            addhashed(union_set, b->slots[i], hashfor(union_set, b, i));
+        }
+    }
+    return union_set;
+}
+
+/*
+ * Returns the intersection of the two given sets; the
+ * returned set contains all elements that are contained
+ * in both a and b.
+ *
+ * The smaller set is scanned and the larger one probed, so the
+ * cost is linear in the size of the smaller set.
+ */
+set_t *set_intersection(set_t *a, set_t *b)
+{
+    set_t *intersection_set = set_createhash(a->cmpfunc, a->hashfunc);
+    set_t *small = a, *large = b;
+    int i;
+
+    if (intersection_set == NULL)
+    {
+        return NULL;
+    }
+    if (b->num_items < a->num_items)
+    {
+        small = b;
+        large = a;
+    }
+
+    for (i = 0; i < small->num_slots; i++)
+    {
+        void *elem = small->slots[i];
+
+        if (elem != NULL)
+        {
+            unsigned long h = hashfor(large, small, i);
+
+            if (large->slots[findslot(large, elem, h)] != NULL)
+            {
+                addhashed(intersection_set, elem,
+                          hashfor(intersection_set, small, i));
+            }
+        }
+    }
+    return intersection_set;
+}
+
+/*
+ * Returns the set difference of the two given sets; the
+ * returned set contains all elements that are contained
+ * in a and not in b.
+ */
+set_t *set_difference(set_t *a, set_t *b)
+{
+    set_t *difference_set = set_createhash(a->cmpfunc, a->hashfunc);
+    int i;
+
+    if (difference_set == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < a->num_slots; i++)
+    {
+        void *elem = a->slots[i];
+
+        if (elem != NULL)
+        {
+            if (b->slots[findslot(b, elem, hashfor(b, a, i))] == NULL)
+            {
+                addhashed(difference_set, elem, hashfor(difference_set, a, i));
+            }
+        }
+    }
+    return difference_set;
+}
+
+/*
+ * Removes from a, in place, the elements that are (keepcommon = 0) or
+ * are not (keepcommon = 1) contained in b.
+ *
+ * When a slot is emptied, a later element may be shifted into it, so
+ * the same slot is examined again before moving on.  Elements that
+ * wrap around from the start of the table may be examined twice,
+ * which is harmless since the test gives the same answer.
+ */
+static void filterinplace(set_t *a, set_t *b, int keepcommon)
+{
+    int i = 0;
+
+    while (i < a->num_slots)
+    {
+        void *elem = a->slots[i];
+
+        if (elem != NULL &&
+            (b->slots[findslot(b, elem, hashfor(b, a, i))] != NULL) !=
+            keepcommon)
+        {
+            removeslot(a, i);
+            a->num_items--;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ */
+void set_intersect_inplace(set_t *a, set_t *b)
+{
+    if (a != b)
+    {
+        filterinplace(a, b, 1);
+    }
+}
+
+/*
+ * Replaces the contents of a with the union of a and b.
+ */
+void set_union_inplace(set_t *a, set_t *b)
+{
+    int i;
+
+    if (a == b)
+    {
+        return;
+    }
+
+    reserve(a, a->num_items + b->num_items);
+    for (i = 0; i < b->num_slots; i++)
+    {
+        if (b->slots[i] != NULL)
+        {
+            addhashed(a, b->slots[i], hashfor(a, b, i));
+        }
+    }
+}
+
+/*
+ * Removes from a every element that is contained in b.
+ */
+void set_subtract_inplace(set_t *a, set_t *b)
+{
+    if (a == b)
+    {
+        memset(a->slots, 0, a->num_slots * sizeof(void *));
+        a->num_items = 0;
+        return;
+    }
+    filterinplace(a, b, 0);
+}
+
+/*
+ * Returns the intersection of the n given sets.
+ *
+ * The smallest set drives the search: each of its elements is probed
+ * in the other sets and dropped at the first miss, so the cost is
+ * linear in the size of the smallest set.
+ */
+set_t *set_intersection_many(set_t **sets, int n)
+{
+    set_t *smallest = sets[0];
+    set_t *result = set_createhash(sets[0]->cmpfunc, sets[0]->hashfunc);
+    int i, j;
+
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    for (i = 1; i < n; i++)
+    {
+        if (sets[i]->num_items < smallest->num_items)
+        {
+            smallest = sets[i];
+        }
+    }
+    reserve(result, smallest->num_items);
+
+    for (i = 0; i < smallest->num_slots; i++)
+    {
+        void *elem = smallest->slots[i];
+        int found = elem != NULL;
+
+        for (j = 0; j < n && found; j++)
+        {
+            if (sets[j] != smallest)
+            {
+                unsigned long h = hashfor(sets[j], smallest, i);
+
+                found = sets[j]->slots[findslot(sets[j], elem, h)] != NULL;
+            }
+        }
+        if (found)
+        {
+            addhashed(result, elem, hashfor(result, smallest, i));
+        }
+    }
+    return result;
+}
+
+/*
+ * Returns the union of the n given sets.  The table starts out sized
+ * for the largest input, which it must hold anyway; sizing it for the
+ * sum of the inputs would grossly overshoot when they overlap.
+ */
+set_t *set_union_many(set_t **sets, int n)
+{
+    set_t *result = set_createhash(sets[0]->cmpfunc, sets[0]->hashfunc);
+    int i, j, largest = 0;
+
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (sets[i]->num_items > largest)
+        {
+            largest = sets[i]->num_items;
+        }
+    }
+    reserve(result, largest);
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < sets[i]->num_slots; j++)
+        {
+            if (sets[i]->slots[j] != NULL)
+            {
+                addhashed(result, sets[i]->slots[j],
+                          hashfor(result, sets[i], j));
+            }
+        }
+    }
+    return result;
+}
+
+/*
+ * Counts the elements that a and b have in common, scanning the
+ * smaller set and probing the larger one.  If stop is set, returns as
+ * soon as one common element is found.
+ */
+static int countcommon(set_t *a, set_t *b, int stop)
+{
+    set_t *small = a, *large = b;
+    int i, count = 0;
+
+    if (b->num_items < a->num_items)
+    {
+        small = b;
+        large = a;
+    }
+
+    for (i = 0; i < small->num_slots; i++)
+    {
+        void *elem = small->slots[i];
+
+        if (elem != NULL &&
+            large->slots[findslot(large, elem,
+                                  hashfor(large, small, i))] != NULL)
+        {
+            count++;
+            if (stop)
+            {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/*
+ * Returns the number of elements contained in both a and b.
+ */
+int set_intersection_size(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 0);
+}
+
+/*
+ * Returns the number of elements contained in a and not in b.
+ */
+int set_difference_size(set_t *a, set_t *b)
+{
+    return a->num_items - countcommon(a, b, 0);
+}
+
+/*
+ * Returns 1 if a and b have at least one element in common.
+ */
+int set_intersects(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 1) > 0;
+}
+
+/*
+ * Returns a copy of the given set.
+ */
+set_t *set_copy(set_t *set)
+{
+    set_t *copied_set = malloc(sizeof(set_t));
+    if (copied_set == NULL)
+    {
+        return NULL;
+    }
+
+    if (!allocslots(copied_set, set->num_slots))
+    {
+        free(copied_set);
+        return NULL;
+    }
+    memcpy(copied_set->slots, set->slots, set->num_slots * sizeof(void *));
+    memcpy(copied_set->hashes, set->hashes,
+           set->num_slots * sizeof(unsigned long));
+    copied_set->num_items = set->num_items;
+    copied_set->cmpfunc = set->cmpfunc;
+    copied_set->hashfunc = set->hashfunc;
+    return copied_set;
+}
+
+/*
+ * Creates a new set iterator for iterating over the given set.
+ * Elements are returned in table order, not in sorted order.
+ */
+set_iter_t *set_createiter(set_t *set)
+{
+    set_iter_t *set_iter = malloc(sizeof(set_iter_t));
+    if (set_iter == NULL)
+    {
+        return NULL;
+    }
+
+    set_iter->set = set;
+    set_iter->current = 0;
+    return set_iter;
+}
+
+/*
+ * Destroys the given set iterator.
+ */
+void set_destroyiter(set_iter_t *iter)
+{
+    free(iter);
+}
+
+/*
+ * Returns 0 if the given set iterator has reached the end of the
+ * set, or 1 otherwise.
+ */
+int set_hasnext(set_iter_t *iter)
+{
+    set_t *set = iter->set;
+
+    while (iter->current < set->num_slots && set->slots[iter->current] == NULL)
+    {
+        iter->current++;
+    }
+    return iter->current < set->num_slots;
+}
+
+/*
+ * Returns the next element in the sequence represented by the given
+ * set iterator.
+ */
+void *set_next(set_iter_t *iter)
+{
+    if (!set_hasnext(iter))
+    {
+        return NULL;
+    }
+    return iter->set->slots[iter->current++];
+}
@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "intern.h"
+
+
+/*
+ * Initial number of hash slots; always a power of two.  The slot array
+ * doubles whenever it becomes half full.
+ */
+#define INITIAL_SLOTS 1024
+
+/*
+ * Words are copied into shared blocks of this many bytes, rather than
+ * each getting its own allocation.
+ */
+#define BLOCK_SIZE 65536
+
+typedef struct block block_t;
+
+struct block
+{
+    block_t *next;
+    char data[];
+};
+
+typedef struct word
+{
+    char *str;              /* Lowercased copy, stored in a block */
+    unsigned long hash;
+} word_t;
+
+struct intern
+{
+    unsigned int *slots;    /* IDs by hash, 0 for an empty slot */
+    int numslots;
+    word_t *words;          /* words[id] for IDs 1 to count */
+    int count;
+    int capacity;           /* Number of entries allocated in words */
+    block_t *blocks;        /* All blocks, newest first */
+    int blockused;          /* Bytes used in the newest block */
+    int blocksize;          /* Size of the newest block */
+};
+
+/*
+ * Case-insensitive FNV-1a hash of the first len characters of word.
+ */
+static unsigned long hashword(char *word, int len)
+{
+    unsigned char *s = (unsigned char *)word;
+    unsigned long h = 2166136261UL;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= tolower(s[i]);
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+/*
+ * FNV-1a hash of the first len characters of word, which are already
+ * lowercase.  Equal to hashword for such input.
+ */
+static unsigned long hashfolded(char *word, int len)
+{
+    unsigned char *s = (unsigned char *)word;
+    unsigned long h = 2166136261UL;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= s[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+/*
+ * Returns 1 if the lowercased string stored equals the first len
+ * characters of word, and 0 otherwise.  If folded is set, word is
+ * already lowercase and is compared with memcmp; otherwise case is
+ * ignored.
+ */
+static int sameword(char *stored, char *word, int len, int folded)
+{
+    int i;
+
+    if (folded)
+    {
+        return memcmp(stored, word, len) == 0 && stored[len] == '\0';
+    }
+    for (i = 0; i < len; i++)
+    {
+        if (stored[i] != tolower((unsigned char)word[i]))
+        {
+            return 0;
+        }
+    }
+    return stored[len] == '\0';
+}
+
+/*
+ * Returns the index of the slot holding the given word, or of the
+ * empty slot where it would go.
+ */
+static int findslot(intern_t *table, char *word, int len, unsigned long hash,
+                    int folded)
+{
+    int mask = table->numslots - 1;
+    int i = hash & mask;
+
+    while (table->slots[i] != 0)
+    {
+        word_t *w = &table->words[table->slots[i]];
+
+        if (w->hash == hash && sameword(w->str, word, len, folded))
+        {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * Doubles the number of slots and rehashes every ID, using the stored
+ * hashes.  Returns 0 if allocation failed, leaving the table as it was.
+ */
+static int growslots(intern_t *table)
+{
+    int numslots = table->numslots * 2;
+    unsigned int *slots = calloc(numslots, sizeof(unsigned int));
+    unsigned int id;
+
+    if (slots == NULL)
+    {
+        return 0;
+    }
+    for (id = 1; id <= (unsigned int)table->count; id++)
+    {
+        int i = table->words[id].hash & (numslots - 1);
+
+        while (slots[i] != 0)
+        {
+            i = (i + 1) & (numslots - 1);
+        }
+        slots[i] = id;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->numslots = numslots;
+    return 1;
+}
+
+/*
+ * Returns a lowercased, NUL-terminated copy of the first len
+ * characters of word, stored in the table's blocks, or NULL if
+ * allocation failed.
+ */
+static char *copyword(intern_t *table, char *word, int len)
+{
+    char *copy;
+    int i;
+
+    if (table->blocks == NULL || table->blockused + len + 1 > table->blocksize)
+    {
+        int size = len + 1 > BLOCK_SIZE ? len + 1 : BLOCK_SIZE;
+        block_t *block = malloc(sizeof(block_t) + size);
+
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->next = table->blocks;
+        table->blocks = block;
+        table->blockused = 0;
+        table->blocksize = size;
+    }
+
+    copy = table->blocks->data + table->blockused;
+    for (i = 0; i < len; i++)
+    {
+        copy[i] = tolower((unsigned char)word[i]);
+    }
+    copy[len] = '\0';
+    table->blockused += len + 1;
+    return copy;
+}
+
+intern_t *intern_create(void)
+{
+    intern_t *table = malloc(sizeof(intern_t));
+
+    if (table == NULL)
+    {
+        return NULL;
+    }
+    table->slots = calloc(INITIAL_SLOTS, sizeof(unsigned int));
+    table->words = malloc(INITIAL_SLOTS / 2 * sizeof(word_t));
+    if (table->slots == NULL || table->words == NULL)
+    {
+        free(table->slots);
+        free(table->words);
+        free(table);
+        return NULL;
+    }
+    table->numslots = INITIAL_SLOTS;
+    table->count = 0;
+    table->capacity = INITIAL_SLOTS / 2;
+    table->blocks = NULL;
+    table->blockused = 0;
+    table->blocksize = 0;
+    return table;
+}
+
+void intern_destroy(intern_t *table)
+{
+    block_t *block = table->blocks;
+
+    while (block != NULL)
+    {
+        block_t *tmp = block;
+        block = block->next;
+        free(tmp);
+    }
+    free(table->slots);
+    free(table->words);
+    free(table);
+}
+
+/*
+ * Returns the ID of the given word, with the given hash, adding it if
+ * it is new.  If folded is set, the word is known to be lowercase.
+ */
+static unsigned int intern(intern_t *table, char *word, int len,
+                           unsigned long hash, int folded)
+{
+    int i = findslot(table, word, len, hash, folded);
+    unsigned int id;
+    char *copy;
+
+    if (table->slots[i] != 0)
+    {
+        return table->slots[i];
+    }
+
+    /* A new word; make room first, so the table stays consistent if
+     * any allocation fails. */
+    if (table->count + 1 >= table->capacity)
+    {
+        word_t *words = realloc(table->words,
+                                table->capacity * 2 * sizeof(word_t));
+        if (words == NULL)
+        {
+            return 0;
+        }
+        table->words = words;
+        table->capacity *= 2;
+    }
+    if ((table->count + 1) * 2 > table->numslots)
+    {
+        if (!growslots(table))
+        {
+            return 0;
+        }
+        i = findslot(table, word, len, hash, folded);
+    }
+    copy = copyword(table, word, len);
+    if (copy == NULL)
+    {
+        return 0;
+    }
+
+    id = ++table->count;
+    table->words[id].str = copy;
+    table->words[id].hash = hash;
+    table->slots[i] = id;
+    return id;
+}
+
+unsigned int intern_word(intern_t *table, char *word)
+{
+    return intern_wordn(table, word, strlen(word));
+}
+
+unsigned int intern_wordn(intern_t *table, char *word, int len)
+{
+    return intern(table, word, len, hashword(word, len), 0);
+}
+
+unsigned int intern_foldedn(intern_t *table, char *word, int len)
+{
+    return intern(table, word, len, hashfolded(word, len), 1);
+}
+
+char *intern_string(intern_t *table, unsigned int id)
+{
+    if (id == 0 || id > (unsigned int)table->count)
+    {
+        return NULL;
+    }
+    return table->words[id].str;
+}
+
+int intern_count(intern_t *table)
+{
+    return table->count;
+}
+
+int compare_ids(void *a, void *b)
+{
+    uintptr_t ia = (uintptr_t)a;
+    uintptr_t ib = (uintptr_t)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+unsigned long hash_id(void *elem)
+{
+    return (unsigned long)(uintptr_t)elem;
+}
@@ -0,0 +1,83 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+/*
+ * The type of intern tables.  An intern table maps each distinct word,
+ * ignoring case, to a small integer ID.  IDs are dense: the n words
+ * interned so far have the IDs 1 to n, in the order they were first
+ * seen, so 0 is never a valid ID.
+ *
+ * Once words are interned, sets and lists can store IDs instead of
+ * strings (see INTERN_ELEM), and compare them as integers.
+ */
+typedef struct intern intern_t;
+
+/*
+ * Converts between word IDs and the element pointers stored in sets
+ * and lists.  Since IDs are never 0, an ID element is never NULL.
+ */
+#define INTERN_ELEM(id) ((void *)(uintptr_t)(id))
+#define INTERN_ID(elem) ((unsigned int)(uintptr_t)(elem))
+
+/*
+ * Creates a new, empty intern table.
+ *
+ * Returns the new table, or NULL if allocation failed.
+ */
+intern_t *intern_create(void);
+
+/*
+ * Destroys the given intern table, along with the stored copies of
+ * its words.
+ */
+void intern_destroy(intern_t *table);
+
+/*
+ * Returns the ID of the given word, adding a lowercased copy of it to
+ * the table if it was not there already.  The table does not keep a
+ * reference to word, so the caller may free it afterwards.
+ *
+ * Returns 0 if the word had to be added and allocation failed.
+ */
+unsigned int intern_word(intern_t *table, char *word);
+
+/*
+ * Like intern_word, but for the len characters at word, which need
+ * not be NUL-terminated.  Meant for token views into a larger buffer,
+ * such as those of tokenizer.h.
+ */
+unsigned int intern_wordn(intern_t *table, char *word, int len);
+
+/*
+ * Like intern_wordn, but for words already in lowercase, such as the
+ * tokens of tokenizer.h.  Skips case folding, and compares words with
+ * memcmp.  Gives wrong results if word contains uppercase letters.
+ */
+unsigned int intern_foldedn(intern_t *table, char *word, int len);
+
+/*
+ * Returns the lowercased word with the given ID, or NULL if there is
+ * no such ID.  The string is owned by the table.
+ */
+char *intern_string(intern_t *table, unsigned int id);
+
+/*
+ * Returns the number of distinct words in the given table.
+ */
+int intern_count(intern_t *table);
+
+/*
+ * Comparison function for ID elements, for use with sets and lists.
+ * Orders IDs numerically, which is not the alphabetical order of the
+ * words.
+ */
+int compare_ids(void *a, void *b);
+
+/*
+ * Hash function for ID elements, consistent with compare_ids.
+ */
+unsigned long hash_id(void *elem);
+
+#endif
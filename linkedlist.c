@@ -2,6 +2,7 @@
 #include "list.h"
 
 #include <stdlib.h>
+#include <pthread.h>
 
 struct listnode;
 
@@ -18,15 +19,96 @@ struct list {
     listnode_t *tail;
     int size;
     cmpfunc_t cmpfunc;
+    listpool_t *pool;
+};
+
+/*
+ * Pools allocate slabs of SLAB_MIN nodes at first, doubling the slab
+ * size each time up to SLAB_MAX, so small pools stay small while big
+ * ones need few allocations.
+ */
+#define SLAB_MIN 16
+#define SLAB_MAX 4096
+
+typedef struct slab slab_t;
+
+struct slab {
+    slab_t *next;
+    listnode_t nodes[];
+};
+
+struct listpool {
+    slab_t *slabs;          /* All slabs, newest first */
+    listnode_t *free;       /* Returned nodes, linked through next */
+    int slabsize;           /* Number of nodes in the newest slab */
+    int used;               /* Nodes handed out from the newest slab */
 };
 
 struct list_iter {
     listnode_t *node;
 };
 
-static listnode_t *newnode(void *elem)
+listpool_t *listpool_create(void)
+{
+    listpool_t *pool = malloc(sizeof(listpool_t));
+    if (pool == NULL)
+        return NULL;
+
+    pool->slabs = NULL;
+    pool->free = NULL;
+    pool->slabsize = 0;
+    pool->used = 0;
+    return pool;
+}
+
+void listpool_destroy(listpool_t *pool)
 {
-    listnode_t *node = malloc(sizeof(listnode_t));
+    slab_t *slab = pool->slabs;
+    while (slab != NULL) {
+        slab_t *tmp = slab;
+        slab = slab->next;
+        free(tmp);
+    }
+    free(pool);
+}
+
+/*
+ * Takes a node from the given pool, reusing a returned node if there
+ * is one, and otherwise carving it from the newest slab.
+ */
+static listnode_t *poolalloc(listpool_t *pool)
+{
+    listnode_t *node;
+
+    if (pool->free != NULL) {
+        node = pool->free;
+        pool->free = node->next;
+        return node;
+    }
+    if (pool->slabs == NULL || pool->used == pool->slabsize) {
+        int size = pool->slabsize == 0 ? SLAB_MIN : pool->slabsize * 2;
+        slab_t *slab;
+
+        if (size > SLAB_MAX)
+            size = SLAB_MAX;
+        slab = malloc(sizeof(slab_t) + size * sizeof(listnode_t));
+        if (slab == NULL)
+            return NULL;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->slabsize = size;
+        pool->used = 0;
+    }
+    return &pool->slabs->nodes[pool->used++];
+}
+
+static listnode_t *newnode(list_t *list, void *elem)
+{
+    listnode_t *node;
+    if (list->pool != NULL)
+        node = poolalloc(list->pool);
+    else
+        node = malloc(sizeof(listnode_t));
     if (node == NULL)
         return NULL;
     
@@ -36,7 +118,23 @@ static listnode_t *newnode(void *elem)
     return node;
 }
 
+static void freenode(list_t *list, listnode_t *node)
+{
+    if (list->pool != NULL) {
+        node->next = list->pool->free;
+        list->pool->free = node;
+    }
+    else {
+        free(node);
+    }
+}
+
 list_t *list_create(cmpfunc_t cmpfunc)
+{
+    return list_createpooled(cmpfunc, NULL);
+}
+
+list_t *list_createpooled(cmpfunc_t cmpfunc, listpool_t *pool)
 {
     list_t *list = malloc(sizeof(list_t));
     if (list == NULL)
@@ -46,12 +144,23 @@ list_t *list_create(cmpfunc_t cmpfunc)
     list->tail = NULL;
     list->size = 0;
     list->cmpfunc = cmpfunc;
+    list->pool = pool;
     return list;
 }
 
 void list_destroy(list_t *list)
 {
     listnode_t *node = list->head;
+
+    /* Pooled nodes are already chained; hand them all back at once */
+    if (list->pool != NULL) {
+        if (list->tail != NULL) {
+            list->tail->next = list->pool->free;
+            list->pool->free = list->head;
+        }
+        free(list);
+        return;
+    }
     while (node != NULL) {
 	    listnode_t *tmp = node;
 	    node = node->next;
@@ -67,7 +176,7 @@ int list_size(list_t *list)
 
 int list_addfirst(list_t *list, void *elem)
 {
-    listnode_t *node = newnode(elem);
+    listnode_t *node = newnode(list, elem);
     if (node == NULL)
         return 0;
     
@@ -85,7 +194,7 @@ int list_addfirst(list_t *list, void *elem)
 
 int list_addlast(list_t *list, void *elem)
 {
-    listnode_t *node = newnode(elem);
+    listnode_t *node = newnode(list, elem);
     if (node == NULL)
         return 0;
     
@@ -117,7 +226,7 @@ void *list_popfirst(list_t *list)
 	        list->head->prev = NULL;
 	    }
 	    list->size--;
-	    free(tmp);
+	    freenode(list, tmp);
 	    return elem;
     }
 }
@@ -137,7 +246,7 @@ void *list_poplast(list_t *list)
 	    else {
 	        list->tail->next = NULL;
 	    }
-	    free(tmp);
+	    freenode(list, tmp);
 	    list->size--;
 	    return elem;
     }
@@ -196,63 +305,204 @@ static listnode_t *merge(listnode_t *a, listnode_t *b, cmpfunc_t cmpfunc)
 }
 
 /*
- * Splits the given list in two halves, and returns the head of
- * the second half.
+ * Cuts the leading run off the list starting at *rest, and returns it
+ * in ascending order with *rest advanced past it.  A run is a longest
+ * non-descending prefix, or a longest strictly descending one, which
+ * is reversed.  Only next pointers are maintained.
  */
-static listnode_t *splitlist(listnode_t *head)
+static listnode_t *nextrun(listnode_t **rest, cmpfunc_t cmpfunc)
 {
-	listnode_t *slow, *fast, *half;
-	
-	/* Move two pointers, a 'slow' one and a 'fast' one which moves
-	 * twice as fast.  When the fast one reaches the end of the list,
-	 * the slow one will be at the middle.
-	 */
-	slow = head;
-	fast = head->next;
-	while (fast != NULL && fast->next != NULL) {
-		slow = slow->next;
-		fast = fast->next->next;
-	}
-	/* Now 'cut' the list and return the second half */
-	half = slow->next;
-	slow->next = NULL;
-	return half;
+    listnode_t *head = *rest, *tail = head, *next;
+
+    if (head->next != NULL && cmpfunc(head->elem, head->next->elem) > 0) {
+        /* Descending: reverse nodes onto the front as we go */
+        next = head->next;
+        head->next = NULL;
+        while (next != NULL && cmpfunc(tail->elem, next->elem) > 0) {
+            listnode_t *after = next->next;
+            tail = next;
+            next->next = head;
+            head = next;
+            next = after;
+        }
+        *rest = next;
+        return head;
+    }
+    while (tail->next != NULL && cmpfunc(tail->elem, tail->next->elem) <= 0)
+        tail = tail->next;
+    *rest = tail->next;
+    tail->next = NULL;
+    return head;
 }
 
 /*
- * Recursive merge sort.  This function is named mergesort_ to avoid
- * collision with the mergesort function that is defined by the standard
- * library on some platforms.
+ * Number of pending runs kept by naturalsort.  Slot i holds a run made
+ * of about 2^i natural runs, so this covers any list whose size fits
+ * in an int.
  */
-static listnode_t *mergesort_(listnode_t *head, cmpfunc_t cmpfunc)
+#define MAXLEVELS 32
+
+/*
+ * Iterative natural merge sort.  Splits the list into its existing
+ * sorted runs and merges them like a binary counter: a new run is
+ * merged with the pending run of equal rank, and the result carried to
+ * the next rank.  A sorted (or reverse sorted) list is a single run
+ * and costs one pass, with no recursion and no list splitting.
+ */
+static listnode_t *naturalsort(listnode_t *head, cmpfunc_t cmpfunc)
 {
-    if (head->next == NULL) {
-        return head;
+    listnode_t *pending[MAXLEVELS];
+    listnode_t *run;
+    int i;
+
+    for (i = 0; i < MAXLEVELS; i++)
+        pending[i] = NULL;
+
+    while (head != NULL) {
+        run = nextrun(&head, cmpfunc);
+        /* Earlier runs sit in pending, so they go first in each merge */
+        for (i = 0; i < MAXLEVELS - 1 && pending[i] != NULL; i++) {
+            run = merge(pending[i], run, cmpfunc);
+            pending[i] = NULL;
+        }
+        if (pending[i] != NULL)
+            run = merge(pending[i], run, cmpfunc);
+        pending[i] = run;
     }
-    else {
-        listnode_t *half = splitlist(head);
-        head = mergesort_(head, cmpfunc);
-        half = mergesort_(half, cmpfunc);
-        return merge(head, half, cmpfunc);
+
+    run = NULL;
+    for (i = 0; i < MAXLEVELS; i++) {
+        if (pending[i] != NULL)
+            run = run == NULL ? pending[i] : merge(pending[i], run, cmpfunc);
+    }
+    return run;
+}
+
+/*
+ * Sets the prev pointers and the tail of the given list from its head
+ * and next pointers.
+ */
+static void fixlinks(list_t *list)
+{
+    listnode_t *prev, *n;
+
+    prev = NULL;
+    for (n = list->head; n != NULL; n = n->next) {
+        n->prev = prev;
+        prev = n;
     }
+    list->tail = prev;
 }
 
 void list_sort(list_t *list)
 {
     if (list->head != NULL) {
-        listnode_t *prev, *n;
-    
-        /* Recursively sort the list */
-        list->head = mergesort_(list->head, list->cmpfunc);
+        /* Sort the list by merging its natural runs */
+        list->head = naturalsort(list->head, list->cmpfunc);
     
         /* Fix the tail and prev links */
-        prev = NULL;
-        for (n = list->head; n != NULL; n = n->next) {
-            n->prev = prev;
-            prev = n;
+        fixlinks(list);
+    }
+}
+
+/*
+ * A unit of work for list_sort_parallel: sorts the segment at head, or
+ * if other is set, merges the sorted segments head and other.  The
+ * result is left in head.
+ */
+typedef struct sortjob {
+    listnode_t *head;
+    listnode_t *other;
+    cmpfunc_t cmpfunc;
+    int threaded;
+} sortjob_t;
+
+static void *sortworker(void *arg)
+{
+    sortjob_t *job = arg;
+
+    if (job->other == NULL)
+        job->head = naturalsort(job->head, job->cmpfunc);
+    else
+        job->head = merge(job->head, job->other, job->cmpfunc);
+    return NULL;
+}
+
+/*
+ * Runs jobs[0..n) in parallel, the last one on the calling thread.
+ * A job whose thread cannot be started runs on the calling thread.
+ */
+static void runjobs(sortjob_t *jobs, pthread_t *threads, int n)
+{
+    int i;
+
+    for (i = 0; i < n - 1; i++) {
+        jobs[i].threaded =
+            pthread_create(&threads[i], NULL, sortworker, &jobs[i]) == 0;
+        if (!jobs[i].threaded)
+            sortworker(&jobs[i]);
+    }
+    sortworker(&jobs[n - 1]);
+    for (i = 0; i < n - 1; i++) {
+        if (jobs[i].threaded)
+            pthread_join(threads[i], NULL);
+    }
+}
+
+void list_sort_parallel(list_t *list, int nthreads)
+{
+    sortjob_t *jobs;
+    pthread_t *threads;
+    listnode_t *node, *next;
+    int i, j, k, n;
+
+    if (nthreads < 2 || list->size < LIST_PARALLEL_THRESHOLD) {
+        list_sort(list);
+        return;
+    }
+    if (nthreads > list->size)
+        nthreads = list->size;
+
+    jobs = malloc(nthreads * sizeof(sortjob_t));
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (jobs == NULL || threads == NULL) {
+        free(jobs);
+        free(threads);
+        list_sort(list);
+        return;
+    }
+
+    /* Cut the list into nthreads segments of nearly equal size */
+    node = list->head;
+    for (i = 0; i < nthreads; i++) {
+        int len = list->size / nthreads + (i < list->size % nthreads);
+
+        jobs[i].head = node;
+        jobs[i].other = NULL;
+        jobs[i].cmpfunc = list->cmpfunc;
+        for (j = 1; j < len; j++)
+            node = node->next;
+        next = node->next;
+        node->next = NULL;
+        node = next;
+    }
+    runjobs(jobs, threads, nthreads);
+
+    /* Merge neighbouring segments pairwise until one is left */
+    for (n = nthreads; n > 1; n = k) {
+        for (i = 0, k = 0; i + 1 < n; i += 2, k++) {
+            jobs[k].head = jobs[i].head;
+            jobs[k].other = jobs[i + 1].head;
         }
-        list->tail = prev;
+        runjobs(jobs, threads, k);
+        if (n % 2 == 1)
+            jobs[k++].head = jobs[n - 1].head;
     }
+
+    list->head = jobs[0].head;
+    fixlinks(list);
+    free(jobs);
+    free(threads);
 }
 
 /*
@@ -20,6 +20,36 @@ typedef struct list list_t;
  */
 list_t *list_create(cmpfunc_t cmpfunc);
 
+/*
+ * The type of node pools.  A pool hands out list nodes from large,
+ * contiguous slabs and takes them back on a free list, so lists that
+ * share a pool need not call malloc and free for every element.
+ */
+typedef struct listpool listpool_t;
+
+/*
+ * Creates a new, empty node pool.
+ *
+ * Returns the new pool, or NULL if allocation failed.
+ */
+listpool_t *listpool_create(void);
+
+/*
+ * Destroys the given node pool, releasing all of its slabs at once.
+ * Every list created with the pool must be destroyed first.
+ */
+void listpool_destroy(listpool_t *pool);
+
+/*
+ * Creates a new, empty list like list_create, but which takes its
+ * nodes from the given pool.  Nodes of a destroyed list go back to
+ * the pool in one step, for reuse by later lists.  If pool is NULL,
+ * this is the same as list_create.
+ *
+ * Returns the new list.
+ */
+list_t *list_createpooled(cmpfunc_t cmpfunc, listpool_t *pool);
+
 /*
  * Destroys the given list.  Subsequently accessing the list
  * will lead to undefined behavior.
@@ -66,6 +96,23 @@ int list_contains(list_t *list, void *elem);
  */
 void list_sort(list_t *list);
 
+/*
+ * Lists with fewer elements than this are not worth splitting across
+ * threads; list_sort_parallel sorts them with list_sort.  May be
+ * overridden at compile time.
+ */
+#ifndef LIST_PARALLEL_THRESHOLD
+#define LIST_PARALLEL_THRESHOLD 65536
+#endif
+
+/*
+ * Sorts the elements of the given list like list_sort, but splits the
+ * list into segments that are sorted on up to nthreads threads and
+ * then merged, also in parallel.  Lists shorter than
+ * LIST_PARALLEL_THRESHOLD, or an nthreads below 2, use list_sort.
+ */
+void list_sort_parallel(list_t *list, int nthreads);
+
 /*
  * The type of list iterators.
  */
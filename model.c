@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "model.h"
+#include "sort.h"
+#include "bloom.h"
+
+
+/*
+ * Identifies model files, and their version.
+ */
+#define MODEL_MAGIC "SPAMMDL3"
+
+/*
+ * The start of a model file.  It is padded to HEADER_SIZE bytes, and
+ * followed by the Bloom filter of the trigger words, count[t] + 1
+ * offsets into the words of each table t, the last one being
+ * strsize[t], and then by the strsize[t] bytes of the words of each
+ * table.  Keeping every index ahead of every word keeps the indexes
+ * aligned.
+ */
+typedef struct header
+{
+    char magic[8];                  /* MODEL_MAGIC, not NUL-terminated */
+    uint32_t numspam;
+    uint32_t numnonspam;
+    uint32_t count[MODEL_TABLES];   /* Number of words */
+    uint32_t strsize[MODEL_TABLES]; /* Bytes of words, with their NULs */
+    uint32_t bloomblocks;           /* Blocks of the Bloom filter */
+} header_t;
+
+/*
+ * The size of the header on disk.  A cache line, so the blocks of the
+ * Bloom filter, which follow it, are aligned like the mapping.
+ */
+#define HEADER_SIZE 64
+
+typedef struct table
+{
+    int count;
+    uint32_t *offsets;      /* Where each word starts in strings */
+    char *strings;
+} table_t;
+
+struct model
+{
+    char *data;             /* The mapped file */
+    size_t size;
+    header_t *header;
+    bloom_t triggers;       /* Filter in front of MODEL_TRIGGERS */
+    table_t tables[MODEL_TABLES];
+};
+
+/*
+ * Comparison function for words, in the order of model files.
+ */
+static int compare_words(void *a, void *b)
+{
+    return strcmp(a, b);
+}
+
+/*
+ * Writes a model file holding the n[t] sorted, distinct words of each
+ * table t at sorted[t] to f.
+ * Returns 1 on success, or 0, with errno set, on failure.
+ */
+static int writemodel(FILE *f, modelspec_t *spec, char **sorted[], int n[])
+{
+    uint32_t *offsets[MODEL_TABLES] = { NULL };
+    char padded[HEADER_SIZE];
+    header_t header;
+    bloom_t *bloom;
+    int t, i, ok = 1;
+
+    bloom = bloom_create(n[MODEL_TRIGGERS]);
+    if (bloom == NULL)
+    {
+        return 0;
+    }
+    for (i = 0; i < n[MODEL_TRIGGERS]; i++)
+    {
+        char *word = sorted[MODEL_TRIGGERS][i];
+
+        bloom_add(bloom, bloom_hash(word, strlen(word)));
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_MAGIC, sizeof(header.magic));
+    header.numspam = spec->numspam;
+    header.numnonspam = spec->numnonspam;
+    header.bloomblocks = bloom->nblocks;
+    for (t = 0; ok && t < MODEL_TABLES; t++)
+    {
+        size_t strsize = 0;
+
+        offsets[t] = malloc((n[t] + 1) * sizeof(uint32_t));
+        if (offsets[t] == NULL)
+        {
+            ok = 0;
+            break;
+        }
+        for (i = 0; i < n[t]; i++)
+        {
+            offsets[t][i] = strsize;
+            strsize += strlen(sorted[t][i]) + 1;
+            if (strsize > UINT32_MAX)
+            {
+                errno = EFBIG;
+                ok = 0;
+                break;
+            }
+        }
+        offsets[t][n[t]] = strsize;
+        header.count[t] = n[t];
+        header.strsize[t] = strsize;
+    }
+
+    memset(padded, 0, sizeof(padded));
+    memcpy(padded, &header, sizeof(header));
+    ok = ok && fwrite(padded, sizeof(padded), 1, f) == 1 &&
+        fwrite(bloom->blocks, BLOOM_BLOCK * sizeof(uint32_t), bloom->nblocks,
+               f) == bloom->nblocks;
+    for (t = 0; ok && t < MODEL_TABLES; t++)
+    {
+        ok = fwrite(offsets[t], sizeof(uint32_t), n[t] + 1, f) ==
+            (size_t)n[t] + 1;
+    }
+    for (t = 0; ok && t < MODEL_TABLES; t++)
+    {
+        for (i = 0; ok && i < n[t]; i++)
+        {
+            ok = fwrite(sorted[t][i], strlen(sorted[t][i]) + 1, 1, f) == 1;
+        }
+    }
+    for (t = 0; t < MODEL_TABLES; t++)
+    {
+        free(offsets[t]);
+    }
+    bloom_destroy(bloom);
+    return ok;
+}
+
+int model_write(char *filename, modelspec_t *spec)
+{
+    char **sorted[MODEL_TABLES] = { NULL };
+    int n[MODEL_TABLES];
+    char *tmpname = malloc(strlen(filename) + 5);
+    FILE *f = NULL;
+    int t, ok = tmpname != NULL;
+
+    for (t = 0; ok && t < MODEL_TABLES; t++)
+    {
+        sorted[t] = malloc((spec->n[t] + 1) * sizeof(char *));
+        if (sorted[t] == NULL)
+        {
+            ok = 0;
+            break;
+        }
+        memcpy(sorted[t], spec->words[t], spec->n[t] * sizeof(char *));
+        n[t] = sort_unique((void **)sorted[t], spec->n[t], compare_words);
+    }
+
+    if (ok)
+    {
+        sprintf(tmpname, "%s.tmp", filename);
+        f = fopen(tmpname, "wb");
+        ok = f != NULL && writemodel(f, spec, sorted, n);
+    }
+    if (f != NULL && fclose(f) != 0)
+    {
+        ok = 0;
+    }
+    if (ok && rename(tmpname, filename) != 0)
+    {
+        ok = 0;
+    }
+    if (!ok && f != NULL)
+    {
+        int saved = errno;
+
+        remove(tmpname);
+        errno = saved;
+    }
+    for (t = 0; t < MODEL_TABLES; t++)
+    {
+        free(sorted[t]);
+    }
+    free(tmpname);
+    return ok;
+}
+
+model_t *model_open(char *filename)
+{
+    model_t *model;
+    header_t *header;
+    struct stat st;
+    size_t expected;
+    char *pos;
+    void *data;
+    int fd, t;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < HEADER_SIZE)
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    /* Only the layout is checked; the words are trusted as written */
+    header = data;
+    expected = HEADER_SIZE +
+        (size_t)header->bloomblocks * BLOOM_BLOCK * sizeof(uint32_t);
+    for (t = 0; t < MODEL_TABLES; t++)
+    {
+        if (header->count[t] > INT32_MAX)
+        {
+            break;
+        }
+        expected += ((size_t)header->count[t] + 1) * sizeof(uint32_t) +
+            header->strsize[t];
+    }
+    if (memcmp(header->magic, MODEL_MAGIC, sizeof(header->magic)) != 0 ||
+        t < MODEL_TABLES || header->bloomblocks == 0 ||
+        (size_t)st.st_size != expected)
+    {
+        munmap(data, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    model = malloc(sizeof(model_t));
+    if (model == NULL)
+    {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    model->data = data;
+    model->size = st.st_size;
+    model->header = header;
+    pos = (char *)data + HEADER_SIZE;
+    model->triggers.blocks = (uint32_t *)pos;
+    model->triggers.nblocks = header->bloomblocks;
+    pos += (size_t)header->bloomblocks * BLOOM_BLOCK * sizeof(uint32_t);
+    for (t = 0; t < MODEL_TABLES; t++)
+    {
+        model->tables[t].count = header->count[t];
+        model->tables[t].offsets = (uint32_t *)pos;
+        pos += (header->count[t] + 1) * sizeof(uint32_t);
+    }
+    for (t = 0; t < MODEL_TABLES; t++)
+    {
+        table_t *table = &model->tables[t];
+
+        table->strings = pos;
+        pos += header->strsize[t];
+        if (table->offsets[table->count] != header->strsize[t])
+        {
+            model_close(model);
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+#ifdef MADV_RANDOM
+    madvise(data, model->size, MADV_RANDOM);
+#endif
+    return model;
+}
+
+void model_close(model_t *model)
+{
+    munmap(model->data, model->size);
+    free(model);
+}
+
+unsigned int model_files(model_t *model, int spam)
+{
+    return spam ? model->header->numspam : model->header->numnonspam;
+}
+
+int model_count(model_t *model, int table)
+{
+    return model->tables[table].count;
+}
+
+char *model_word(model_t *model, int table, int i)
+{
+    table_t *t = &model->tables[table];
+
+    return t->strings + t->offsets[i];
+}
+
+char **model_words(model_t *model, int table)
+{
+    table_t *t = &model->tables[table];
+    char **words = malloc((t->count + 1) * sizeof(char *));
+    int i;
+
+    if (words == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < t->count; i++)
+    {
+        words[i] = t->strings + t->offsets[i];
+    }
+    return words;
+}
+
+int model_find(model_t *model, int table, char *word, int len)
+{
+    table_t *t = &model->tables[table];
+    int lo = 0, hi = t->count;
+
+    /* Most tokens are not trigger words, and most of those stop here */
+    if (table == MODEL_TRIGGERS &&
+        !bloom_check(&model->triggers, bloom_hash(word, len)))
+    {
+        return -1;
+    }
+
+    /* Words are ordered as by strcmp: bytewise, then shorter first */
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        char *stored = t->strings + t->offsets[mid];
+        int storedlen = t->offsets[mid + 1] - t->offsets[mid] - 1;
+        int cmp = memcmp(stored, word, storedlen < len ? storedlen : len);
+
+        if (cmp == 0)
+        {
+            cmp = (storedlen > len) - (storedlen < len);
+        }
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else if (cmp > 0)
+        {
+            hi = mid;
+        }
+        else
+        {
+            return mid;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,104 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+/*
+ * The type of trained models.  A model is a file holding word tables
+ * in a form that is used as it lies on disk: a header, an index of
+ * offsets for each table, and the words themselves, lowercased,
+ * NUL-terminated and sorted.  Opening a model maps the file, and
+ * lookups binary search an index in the mapping, so nothing is parsed
+ * or copied, and startup does not depend on its size.
+ *
+ * The words of a table are numbered 0 to count - 1 in sorted order.
+ * Models use the byte order of the machine that wrote them.
+ */
+typedef struct model model_t;
+
+/*
+ * The tables of a model.  Classifying only needs the trigger words;
+ * the spam and nonspam words are the training state that a model
+ * update starts from.
+ */
+enum
+{
+    MODEL_TRIGGERS,         /* Spam words that are not nonspam words */
+    MODEL_SPAM,             /* Words in every spam file so far */
+    MODEL_NONSPAM,          /* Words in any nonspam file so far */
+    MODEL_TABLES
+};
+
+/*
+ * The contents of a model to write: the numbers of spam and nonspam
+ * files it was trained on, and n[t] words at words[t] for each table t.
+ */
+typedef struct modelspec
+{
+    unsigned int numspam;
+    unsigned int numnonspam;
+    char **words[MODEL_TABLES];
+    int n[MODEL_TABLES];
+} modelspec_t;
+
+/*
+ * Writes a model with the given contents to the given file.  The words
+ * must be lowercase, but need not be sorted or distinct, and the
+ * arrays themselves are not modified; sorted input is detected in one
+ * pass.  The model is written to a temporary file first and then
+ * renamed, so a model that is open elsewhere, even the one it was
+ * updated from, is never seen half written.
+ *
+ * Returns 1 on success, or 0, with errno set, if the file could not
+ * be written or allocation failed.
+ */
+int model_write(char *filename, modelspec_t *spec);
+
+/*
+ * Maps the given model file and returns the model.  The file is only
+ * read, never modified.
+ * Returns NULL, with errno set, if the file cannot be opened or
+ * mapped, or (EINVAL) is not a model.
+ */
+model_t *model_open(char *filename);
+
+/*
+ * Unmaps the model file and destroys the given model.  Every word it
+ * returned becomes invalid.
+ */
+void model_close(model_t *model);
+
+/*
+ * Returns the number of spam or nonspam files the model was trained
+ * on, depending on spam.
+ */
+unsigned int model_files(model_t *model, int spam);
+
+/*
+ * Returns the number of words in the given table of the model.
+ */
+int model_count(model_t *model, int table);
+
+/*
+ * Returns word i of the given table, which is owned by the model.
+ */
+char *model_word(model_t *model, int table, int i);
+
+/*
+ * Returns the words of the given table as an array of model_count
+ * pointers, in sorted order, or NULL if allocation failed.  The array
+ * must be freed by the caller; the words are owned by the model.
+ */
+char **model_words(model_t *model, int table);
+
+/*
+ * Returns the number of the word made of the len lowercase characters
+ * at word, which need not be NUL-terminated, in the given table, or
+ * -1 if the table does not hold it.  Meant for the tokens of
+ * tokenizer.h.
+ *
+ * The trigger table has a Bloom filter (see bloom.h), written with
+ * the model, in front of its index.  Most missing words are rejected
+ * by it, with one cache line touched instead of a binary search.
+ */
+int model_find(model_t *model, int table, char *word, int len);
+
+#endif
@@ -1,9 +1,18 @@
 #include <stdlib.h> 
 #include <stdio.h> 
+#include <string.h>
 #include "list.h"
 #include "set.h" 
+#include "sort.h"
 
 
+/*
+ * Lists built for sets of at least this many elements take their
+ * nodes from a pool of their own.  Smaller sets, which include most
+ * results and copies, use plain nodes and do not pay for a pool.
+ */
+#define POOL_MIN 256
+
 /*
  * The type of sets.
  */
@@ -11,8 +20,11 @@
 struct set 
 {
     list_t *list;
+    listpool_t *pool;       /* Pool of list, or NULL */
     cmpfunc_t cmpfunc;
     int sorted;
+    void *max;
+    int peak;               /* Largest size since list was built */
 };
 
 /*
@@ -26,12 +38,18 @@ set_t *set_create(cmpfunc_t cmpfunc)
     
         return NULL;
     
+    /* A set starts out small, so its list has no pool (see POOL_MIN) */
+    set->pool = NULL;
     set->list = list_create(cmpfunc);
     set->cmpfunc = cmpfunc; 
     
-    int sorted = 0;
+    /* An empty set is trivially sorted */
+    set->sorted = 1;
+    set->max = NULL;
+    set->peak = 0;
     if(set->list == NULL)
     {
+        free(set);
         return NULL;
     }
     
@@ -40,6 +58,86 @@ set_t *set_create(cmpfunc_t cmpfunc)
 
 }
 
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set.  This implementation does not hash its
+ * elements, so the hash function is ignored.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc)
+{
+    return set_create(cmpfunc);
+}
+
+
+/*
+ * Creates a new set holding the n elements of the given array.
+ * The elements are sorted and deduplicated once, and then appended
+ * to the list in order, so the set starts out sorted.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    set_t *set = set_create(cmpfunc);
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    if (!set_add_batch(set, elems, n))
+    {
+        set_destroy(set);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Creates a new set holding the elements of the given list.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list)
+{
+    int n = list_size(list);
+    void **elems = malloc((n + 1) * sizeof(void *));
+    list_iter_t *iter;
+    set_t *set;
+    int i = 0;
+
+    if (elems == NULL)
+    {
+        return NULL;
+    }
+
+    iter = list_createiter(list);
+    while (list_hasnext(iter))
+    {
+        elems[i++] = list_next(iter);
+    }
+    list_destroyiter(iter);
+
+    set = set_create_from_array(cmpfunc, elems, n);
+    free(elems);
+    return set;
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  This
+ * implementation does not hash its elements, so the hash function is
+ * ignored.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n)
+{
+    return set_create_from_array(cmpfunc, elems, n);
+}
+
+/*
+ * Creates a new set holding the elements of the given list, ignoring
+ * the hash function as above.
+ */
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list)
+{
+    return set_create_from_list(cmpfunc, list);
+}
 
 /*
  * Destroys the given set.  Subsequently accessing the set
@@ -48,14 +146,71 @@ set_t *set_create(cmpfunc_t cmpfunc)
 void set_destroy(set_t *set)
     {
         list_destroy(set->list);
+        if (set->pool != NULL)
+        {
+            listpool_destroy(set->pool);
+        }
 
         free(set); 
     } 
 
+/*
+ * Creates an empty list for the given set, to be filled with about
+ * size elements.  Large lists get a new pool, which is returned in
+ * *pool, or NULL if the list has none.
+ * Returns the list, or NULL if allocation failed.
+ */
+static list_t *newlist(set_t *set, int size, listpool_t **pool)
+{
+    list_t *list;
+
+    *pool = size >= POOL_MIN ? listpool_create() : NULL;
+    list = list_createpooled(set->cmpfunc, *pool);
+    if (list == NULL && *pool != NULL)
+    {
+        listpool_destroy(*pool);
+    }
+    return list;
+}
+
+/*
+ * Destroys a list from newlist, and its pool.
+ */
+static void droplist(list_t *list, listpool_t *pool)
+{
+    list_destroy(list);
+    if (pool != NULL)
+    {
+        listpool_destroy(pool);
+    }
+}
+
+/*
+ * Replaces the list of the given set with a list from newlist.  The old
+ * list is destroyed together with its pool, so every node of it is
+ * released, not kept for reuse.
+ */
+static void setlist(set_t *set, list_t *list, listpool_t *pool)
+{
+    droplist(set->list, set->pool);
+    set->list = list;
+    set->pool = pool;
+    set->peak = list_size(list);
+}
+
+/*
+ * Sorts the elements of the given set, unless they are already
+ * known to be sorted.
+ */
 void set_sort(set_t * set)
 {
-    set -> sorted = 1; 
+    if (set->sorted)
+    {
+        return;
+    }
+
     list_sort(set->list);
+    set -> sorted = 1; 
 }
 
 /*
@@ -76,7 +231,96 @@ void set_add(set_t *set, void *elem)
         return;
     }
 
-    list_addlast(set->list, elem);
+    /*
+     * The list stays sorted if the new element goes after the largest
+     * one, which is the case whenever a set is filled in order.
+     */
+    if (set->max == NULL || set->cmpfunc(elem, set->max) > 0)
+    {
+        set->max = elem;
+    }
+    else
+    {
+        set->sorted = 0;
+    }
+
+    if (list_addlast(set->list, elem) && list_size(set->list) > set->peak)
+    {
+        set->peak = list_size(set->list);
+    }
+}
+
+/*
+ * Adds the n elements of the given array to the given set.
+ *
+ * The batch is sorted and deduplicated, and the set is sorted, so the
+ * two can be merged in one pass into a new list, which replaces the
+ * old one.  If a node cannot be allocated, the new list is dropped
+ * and the set keeps the old one.
+ */
+int set_add_batch(set_t *set, void **elems, int n)
+{
+    void **batch;
+    list_t *merged;
+    listpool_t *pool;
+    list_iter_t *iter;
+    void *cur, *last = set->max;
+    int j = 0, k, ok;
+
+    if (n == 0)
+    {
+        return 1;
+    }
+    batch = malloc(n * sizeof(void *));
+    if (batch == NULL)
+    {
+        return 0;
+    }
+    memcpy(batch, elems, n * sizeof(void *));
+    k = sort_unique(batch, n, set->cmpfunc);
+
+    set_sort(set);
+    merged = newlist(set, list_size(set->list) + k, &pool);
+    iter = merged == NULL ? NULL : list_createiter(set->list);
+    ok = iter != NULL;
+    cur = ok && list_hasnext(iter) ? list_next(iter) : NULL;
+
+    while (ok && (cur != NULL || j < k))
+    {
+        int cmp = cur == NULL ? 1 : j == k ? -1 : set->cmpfunc(cur, batch[j]);
+
+        if (cmp <= 0)
+        {
+            last = cur;
+            if (cmp == 0)
+            {
+                j++;
+            }
+            cur = list_hasnext(iter) ? list_next(iter) : NULL;
+        }
+        else
+        {
+            last = batch[j++];
+        }
+        ok = list_addlast(merged, last);
+    }
+
+    if (iter != NULL)
+    {
+        list_destroyiter(iter);
+    }
+    if (ok)
+    {
+        /* Everything was appended in order, so the set is still sorted */
+        setlist(set, merged, pool);
+        set->max = last;
+    }
+    else if (merged != NULL)
+    {
+        droplist(merged, pool);
+    }
+    free(batch);
+    return ok;
 }
 
 /*
@@ -175,7 +419,7 @@ set_t *set_difference(set_t *a, set_t *b)
 {
     set_t *difference_set = set_create(a->cmpfunc);
 
-    set_t *iter_a = set_createiter(a);
+    set_iter_t *iter_a = set_createiter(a);
    
     void *item_a = set_next(iter_a);
    
@@ -194,6 +438,410 @@ set_t *set_difference(set_t *a, set_t *b)
     return difference_set; 
 }
 
+/*
+ * Called after elements have been removed from the given set.  Nodes
+ * popped from a pooled list only go back to its pool, so once the set
+ * has shrunk to less than half its peak, its elements are moved to a
+ * new list and the old list is released with its pool.  Each move is
+ * paid for by the removals before it.  If the new list cannot be
+ * built, the set keeps the old one.
+ */
+static void trim(set_t *set)
+{
+    int size = list_size(set->list);
+    listpool_t *pool;
+    list_iter_t *iter;
+    list_t *list;
+    int ok;
+
+    if (size > set->peak)
+    {
+        set->peak = size;
+    }
+    if (set->pool == NULL || size >= set->peak / 2)
+    {
+        return;
+    }
+
+    list = newlist(set, size, &pool);
+    iter = list == NULL ? NULL : list_createiter(set->list);
+    ok = iter != NULL;
+    while (ok && list_hasnext(iter))
+    {
+        ok = list_addlast(list, list_next(iter));
+    }
+    if (iter != NULL)
+    {
+        list_destroyiter(iter);
+    }
+    if (ok)
+    {
+        setlist(set, list, pool);
+    }
+    else if (list != NULL)
+    {
+        droplist(list, pool);
+    }
+}
+
+/*
+ * Merges the sorted elements of b into a, in place.  aonly, both and
+ * bonly select whether elements found only in a, in both sets, or only
+ * in b are kept.  The list of a is rotated: each old element is popped
+ * from the front, and the kept elements are appended in order at the
+ * back, so a ends up sorted.
+ */
+static void mergeinplace(set_t *a, set_t *b, int aonly, int both, int bonly)
+{
+    set_iter_t *iter_b;
+    void *cur = NULL, *item_b;
+    int remaining;
+
+    set_sort(a);
+    iter_b = set_createiter(b);
+    item_b = set_next(iter_b);
+
+    remaining = list_size(a->list);
+    if (remaining > 0)
+    {
+        cur = list_popfirst(a->list);
+        remaining--;
+    }
+    a->max = NULL;
+
+    while (cur != NULL || (bonly && item_b != NULL))
+    {
+        int cmp = cur == NULL ? 1 : item_b == NULL ? -1 : a->cmpfunc(cur, item_b);
+        void *keep = NULL;
+
+        if (cmp > 0)
+        {
+            if (bonly)
+            {
+                keep = item_b;
+            }
+            item_b = set_next(iter_b);
+        }
+        else
+        {
+            if (cmp < 0 ? aonly : both)
+            {
+                keep = cur;
+            }
+            if (cmp == 0)
+            {
+                item_b = set_next(iter_b);
+            }
+            cur = NULL;
+            if (remaining > 0)
+            {
+                cur = list_popfirst(a->list);
+                remaining--;
+            }
+        }
+
+        if (keep != NULL)
+        {
+            list_addlast(a->list, keep);
+            a->max = keep;
+        }
+    }
+    set_destroyiter(iter_b);
+    trim(a);
+}
+
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ */
+void set_intersect_inplace(set_t *a, set_t *b)
+{
+    if (a != b)
+    {
+        mergeinplace(a, b, 0, 1, 0);
+    }
+}
+
+/*
+ * Replaces the contents of a with the union of a and b.
+ */
+void set_union_inplace(set_t *a, set_t *b)
+{
+    if (a != b)
+    {
+        mergeinplace(a, b, 1, 1, 1);
+    }
+}
+
+/*
+ * Removes from a every element that is contained in b.
+ */
+void set_subtract_inplace(set_t *a, set_t *b)
+{
+    if (a == b)
+    {
+        while (list_size(a->list) > 0)
+        {
+            list_popfirst(a->list);
+        }
+        a->max = NULL;
+        trim(a);
+        return;
+    }
+    mergeinplace(a, b, 1, 0, 0);
+}
+
+/*
+ * Returns the intersection of the n given sets.
+ *
+ * The elements of the smallest set are checked against a sorted
+ * iterator over each of the other sets.  The iterators only move
+ * forward, so the whole intersection is a single pass.
+ */
+set_t *set_intersection_many(set_t **sets, int n)
+{
+    set_t *smallest = sets[0];
+    set_t *result = set_create(sets[0]->cmpfunc);
+    set_iter_t **iters = calloc(n, sizeof(set_iter_t *));
+    void **heads = calloc(n, sizeof(void *));
+    void **elems;
+    set_iter_t *iter;
+    int i, j, count = 0, ok = 1;
+
+    for (i = 1; i < n; i++)
+    {
+        if (set_size(sets[i]) < set_size(smallest))
+        {
+            smallest = sets[i];
+        }
+    }
+
+    elems = malloc((set_size(smallest) + 1) * sizeof(void *));
+    if (result == NULL || iters == NULL || heads == NULL || elems == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(iters);
+        free(heads);
+        free(elems);
+        return NULL;
+    }
+
+    for (j = 0; j < n && ok; j++)
+    {
+        if (sets[j] != smallest)
+        {
+            iters[j] = set_createiter(sets[j]);
+            ok = iters[j] != NULL;
+            heads[j] = ok ? set_next(iters[j]) : NULL;
+        }
+    }
+
+    iter = ok ? set_createiter(smallest) : NULL;
+    ok = iter != NULL;
+    while (ok && set_hasnext(iter))
+    {
+        void *elem = set_next(iter);
+        int found = 1;
+
+        for (j = 0; j < n && found; j++)
+        {
+            if (sets[j] == smallest)
+            {
+                continue;
+            }
+            while (heads[j] != NULL && result->cmpfunc(heads[j], elem) < 0)
+            {
+                heads[j] = set_next(iters[j]);
+            }
+            found = heads[j] != NULL && result->cmpfunc(heads[j], elem) == 0;
+        }
+        if (found)
+        {
+            elems[count++] = elem;
+        }
+    }
+    if (iter != NULL)
+    {
+        set_destroyiter(iter);
+    }
+
+    for (j = 0; j < n; j++)
+    {
+        if (iters[j] != NULL)
+        {
+            set_destroyiter(iters[j]);
+        }
+    }
+
+    /* The survivors are already sorted, so this is a plain append */
+    ok = ok && set_add_batch(result, elems, count);
+    free(iters);
+    free(heads);
+    free(elems);
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Returns a newly allocated array holding the elements of the given
+ * set in ascending order, or NULL if the allocation failed.
+ */
+static void **toarray(set_t *set)
+{
+    void **elems = malloc((set_size(set) + 1) * sizeof(void *));
+    set_iter_t *iter;
+    int n = 0;
+
+    if (elems == NULL)
+    {
+        return NULL;
+    }
+
+    iter = set_createiter(set);
+    if (iter == NULL)
+    {
+        free(elems);
+        return NULL;
+    }
+    while (set_hasnext(iter))
+    {
+        elems[n++] = set_next(iter);
+    }
+    set_destroyiter(iter);
+    return elems;
+}
+
+/*
+ * Returns the union of the n given sets.  The sorted contents of each
+ * set are gathered into an array, and the arrays are combined with a
+ * k-way heap merge.
+ */
+set_t *set_union_many(set_t **sets, int n)
+{
+    void ***arrays = calloc(n, sizeof(void **));
+    int *sizes = malloc(n * sizeof(int));
+    set_t *result = set_create(sets[0]->cmpfunc);
+    void **merged;
+    int i, total = 0, ok = 1;
+
+    if (result == NULL || arrays == NULL || sizes == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(arrays);
+        free(sizes);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        sizes[i] = set_size(sets[i]);
+        arrays[i] = toarray(sets[i]);
+        ok = ok && arrays[i] != NULL;
+        total += sizes[i];
+    }
+
+    merged = malloc((total + 1) * sizeof(void *));
+    if (ok && merged != NULL)
+    {
+        int count = sort_mergeunique(arrays, sizes, n, merged, result->cmpfunc);
+
+        ok = count >= 0 && set_add_batch(result, merged, count);
+    }
+    else
+    {
+        ok = 0;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        free(arrays[i]);
+    }
+    free(arrays);
+    free(sizes);
+    free(merged);
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Counts the elements that a and b have in common with a merge pass
+ * over their sorted iterators.  If stop is set, returns as soon as one
+ * common element is found.
+ */
+static int countcommon(set_t *a, set_t *b, int stop)
+{
+    set_iter_t *iter_a = set_createiter(a);
+    set_iter_t *iter_b = set_createiter(b);
+    void *item_a = set_next(iter_a);
+    void *item_b = set_next(iter_b);
+    int count = 0;
+
+    while (item_a != NULL && item_b != NULL)
+    {
+        int cmp = a->cmpfunc(item_a, item_b);
+
+        if (cmp < 0)
+        {
+            item_a = set_next(iter_a);
+        }
+        else if (cmp > 0)
+        {
+            item_b = set_next(iter_b);
+        }
+        else
+        {
+            count++;
+            if (stop)
+            {
+                break;
+            }
+            item_a = set_next(iter_a);
+            item_b = set_next(iter_b);
+        }
+    }
+
+    set_destroyiter(iter_a);
+    set_destroyiter(iter_b);
+    return count;
+}
+
+/*
+ * Returns the number of elements contained in both a and b.
+ */
+int set_intersection_size(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 0);
+}
+
+/*
+ * Returns the number of elements contained in a and not in b.
+ */
+int set_difference_size(set_t *a, set_t *b)
+{
+    return set_size(a) - countcommon(a, b, 0);
+}
+
+/*
+ * Returns 1 if a and b have at least one element in common.
+ */
+int set_intersects(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 1) > 0;
+}
+
 /*
  * Returns a copy of the given set.
  */
@@ -201,9 +849,7 @@ set_t *set_copy(set_t *set)
 {
     set_t *copied_set = set_create(set->cmpfunc);
    
-    copied_set->sorted = set->sorted;
-    
-    set_t *iter = set_createiter(set);
+    set_iter_t *iter = set_createiter(set);
    
     void *item = set_next(iter);
 
@@ -213,6 +859,7 @@ set_t *set_copy(set_t *set)
         
         item = set_next(iter);
     }
+    set_destroyiter(iter);
 
     return copied_set; 
 }
@@ -229,6 +876,8 @@ struct set_iter
 /*
  * Creates a new set iterator for iterating over the given set.
     Should look like list iter, except it is ordered set so it should be ascending order 
+    The list is only re-sorted if the set has changed out of order since
+    the last sort.
  */
 set_iter_t *set_createiter(set_t *set)
 {
@@ -260,7 +909,7 @@ set_iter_t *set_createiter(set_t *set)
  */
 void set_destroyiter(set_iter_t *iter)
 {
-    list_destroy(iter->iter);
+    list_destroyiter(iter->iter);
     
     free(iter);
 }
@@ -3,6 +3,7 @@
 #define SET_H
 
 #include "common.h"
+#include "list.h"
 
 
 /*
@@ -14,9 +15,64 @@ typedef struct set set_t;
 /*
  * Creates a new set using the given comparison function
  * to compare elements of the set.
+ *
+ * Implementations that hash their elements (hashset.c) cannot work
+ * from a comparison function alone, and treat this as a fatal error;
+ * use set_createhash with them.
+ *
+ * The compressed bitmap implementation (bitmapset.c) only holds
+ * integer IDs below 2^32, such as those of intern.h, stored in the
+ * pointers themselves rather than pointed to.  It ignores the
+ * comparison function and orders elements numerically, and adding
+ * any other element is a fatal error.
  */
 set_t *set_create(cmpfunc_t cmpfunc);
 
+/*
+ * The type of hash functions.  A hash function must return the same
+ * value for any two elements that the comparison function considers
+ * equal.
+ */
+typedef unsigned long (*hashfunc_t)(void *);
+
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set, and the given hash function to hash them.
+ * Implementations that do not hash their elements ignore hashfunc
+ * and behave as set_create; the others require it.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc);
+
+/*
+ * Creates a new set using the given comparison function, holding the
+ * n elements of the given array.  Duplicates are dropped.  The array
+ * itself is not modified.
+ *
+ * Ordered implementations sort and deduplicate the elements in one
+ * pass, so this costs O(n log n) rather than n calls to set_add.  Like
+ * set_create, this is an error for implementations that hash; use
+ * set_createhash_from_array with them.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n);
+
+/*
+ * Creates a new set using the given comparison function, holding the
+ * elements of the given list.  Duplicates are dropped.  The list itself
+ * is not modified.  As set_create_from_array, this is an error for
+ * implementations that hash.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list);
+
+/*
+ * As set_create_from_array and set_create_from_list, but with the
+ * given hash function, as for set_createhash.  Implementations that
+ * hash grow their table once and insert in expected O(n) time.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n);
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list);
+
 /*
  * Destroys the given set.  Subsequently accessing the set
  * will lead to undefined behavior.
@@ -33,6 +89,18 @@ int set_size(set_t *set);
  */
 void set_add(set_t *set, void *elem);
 
+/*
+ * Adds the n elements of the given array to the given set.  The array
+ * itself is not modified.
+ *
+ * Ordered implementations sort and deduplicate the batch once and merge
+ * it into the set, instead of searching the set for every element.
+ *
+ * Returns 1 on success, or 0 if allocation failed, in which case some
+ * of the elements may not have been added.
+ */
+int set_add_batch(set_t *set, void **elems, int n);
+
 /*
  * Returns 1 if the given element is contained in
  * the given set, 0 otherwise.
@@ -60,6 +128,57 @@ set_t *set_intersection(set_t *a, set_t *b);
  */
 set_t *set_difference(set_t *a, set_t *b);
 
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ * Unlike set_intersection, no new set is allocated; the storage
+ * of a is reused.
+ */
+void set_intersect_inplace(set_t *a, set_t *b);
+
+/*
+ * Replaces the contents of a with the union of a and b, reusing
+ * the storage of a.
+ */
+void set_union_inplace(set_t *a, set_t *b);
+
+/*
+ * Removes from a every element that is contained in b, reusing
+ * the storage of a.
+ */
+void set_subtract_inplace(set_t *a, set_t *b);
+
+/*
+ * Returns the intersection of the n given sets, computed in one pass
+ * rather than as n - 1 pairwise intersections.  n must be at least 1;
+ * the returned set uses the comparison function of sets[0].
+ */
+set_t *set_intersection_many(set_t **sets, int n);
+
+/*
+ * Returns the union of the n given sets, computed in one pass.
+ * n must be at least 1; the returned set uses the comparison function
+ * of sets[0].
+ */
+set_t *set_union_many(set_t **sets, int n);
+
+/*
+ * Returns the number of elements contained in both a and b, without
+ * building the intersection.
+ */
+int set_intersection_size(set_t *a, set_t *b);
+
+/*
+ * Returns the number of elements contained in a and not in b, without
+ * building the difference.
+ */
+int set_difference_size(set_t *a, set_t *b);
+
+/*
+ * Returns 1 if a and b have at least one element in common, 0
+ * otherwise.  Stops at the first common element found.
+ */
+int set_intersects(set_t *a, set_t *b);
+
 /*
  * Returns a copy of the given set.
  */
@@ -73,6 +192,11 @@ typedef struct set_iter set_iter_t;
 
 /*
  * Creates a new set iterator for iterating over the given set.
+ *
+ * Some implementations sort the set here if it has changed since it
+ * was last sorted.  After that, until the set is modified again, no
+ * function of this interface writes to it, so it may be read from
+ * several threads at once.
  */
 set_iter_t *set_createiter(set_t *set);
 
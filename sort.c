@@ -0,0 +1,474 @@
+#include <stdlib.h>
+#include "sort.h"
+
+
+/*
+ * Ranges of at most this many elements are finished with insertion
+ * sort, which beats quicksort on short inputs.
+ */
+#define INSERTION_CUTOFF 16
+
+/*
+ * sort_intersect and sort_subtract gallop instead of merging once one
+ * input is at least this many times larger than the other.
+ */
+#define GALLOP_RATIO 16
+
+static void swap(void **array, int i, int j)
+{
+    void *tmp = array[i];
+    array[i] = array[j];
+    array[j] = tmp;
+}
+
+/*
+ * Sorts array[lo..hi) with insertion sort.
+ */
+static void insertionsort(void **array, int lo, int hi, cmpfunc_t cmpfunc)
+{
+    int i, j;
+
+    for (i = lo + 1; i < hi; i++)
+    {
+        void *elem = array[i];
+
+        for (j = i; j > lo && cmpfunc(array[j - 1], elem) > 0; j--)
+        {
+            array[j] = array[j - 1];
+        }
+        array[j] = elem;
+    }
+}
+
+/*
+ * Restores the max-heap property below index i of the heap stored in
+ * array[lo..lo+n).
+ */
+static void siftdown(void **array, int lo, int i, int n, cmpfunc_t cmpfunc)
+{
+    for (;;)
+    {
+        int child = 2 * i + 1;
+
+        if (child >= n)
+        {
+            return;
+        }
+        if (child + 1 < n &&
+            cmpfunc(array[lo + child], array[lo + child + 1]) < 0)
+        {
+            child++;
+        }
+        if (cmpfunc(array[lo + i], array[lo + child]) >= 0)
+        {
+            return;
+        }
+        swap(array, lo + i, lo + child);
+        i = child;
+    }
+}
+
+/*
+ * Sorts array[lo..hi) with heapsort.  Used when quicksort recursion
+ * gets too deep, so adversarial inputs stay O(n log n).
+ */
+static void heapsort_(void **array, int lo, int hi, cmpfunc_t cmpfunc)
+{
+    int n = hi - lo;
+    int i;
+
+    for (i = n / 2 - 1; i >= 0; i--)
+    {
+        siftdown(array, lo, i, n, cmpfunc);
+    }
+    for (i = n - 1; i > 0; i--)
+    {
+        swap(array, lo, lo + i);
+        siftdown(array, lo, 0, i, cmpfunc);
+    }
+}
+
+/*
+ * Orders array[a], array[b] and array[c], leaving the median in
+ * array[b].
+ */
+static void median3(void **array, int a, int b, int c, cmpfunc_t cmpfunc)
+{
+    if (cmpfunc(array[b], array[a]) < 0)
+    {
+        swap(array, a, b);
+    }
+    if (cmpfunc(array[c], array[b]) < 0)
+    {
+        swap(array, b, c);
+        if (cmpfunc(array[b], array[a]) < 0)
+        {
+            swap(array, a, b);
+        }
+    }
+}
+
+/*
+ * Sorts array[lo..hi).  depth is the number of partitioning levels
+ * left before falling back to heapsort.  Recurses on the smaller
+ * partition and loops on the larger one, so the stack depth stays
+ * logarithmic.
+ */
+static void introsort(void **array, int lo, int hi, int depth,
+                      cmpfunc_t cmpfunc)
+{
+    while (hi - lo > INSERTION_CUTOFF)
+    {
+        int mid = lo + (hi - lo) / 2;
+        void *pivot;
+        int i, j;
+
+        if (depth-- == 0)
+        {
+            heapsort_(array, lo, hi, cmpfunc);
+            return;
+        }
+
+        /* The median ends up at mid, with sentinels at lo and hi - 1 */
+        median3(array, lo, mid, hi - 1, cmpfunc);
+        pivot = array[mid];
+
+        /* Hoare partition; elements equal to the pivot go both ways,
+         * which keeps runs of duplicates from degrading to O(n^2).
+         */
+        i = lo;
+        j = hi - 1;
+        for (;;)
+        {
+            do
+            {
+                i++;
+            } while (cmpfunc(array[i], pivot) < 0);
+            do
+            {
+                j--;
+            } while (cmpfunc(pivot, array[j]) < 0);
+            if (i >= j)
+            {
+                break;
+            }
+            swap(array, i, j);
+        }
+
+        /* Now array[lo..j] <= pivot <= array[j+1..hi) */
+        if (j + 1 - lo < hi - (j + 1))
+        {
+            introsort(array, lo, j + 1, depth, cmpfunc);
+            lo = j + 1;
+        }
+        else
+        {
+            introsort(array, j + 1, hi, depth, cmpfunc);
+            hi = j + 1;
+        }
+    }
+    insertionsort(array, lo, hi, cmpfunc);
+}
+
+/*
+ * Returns 1 if array[0..n) is already in ascending order.  If it is in
+ * descending order instead, it is reversed in place and 1 is returned.
+ * Otherwise, returns 0.  Either way this costs at most one pass.
+ */
+static int presorted(void **array, int n, cmpfunc_t cmpfunc)
+{
+    int i;
+
+    for (i = 1; i < n && cmpfunc(array[i - 1], array[i]) <= 0; i++)
+        ;
+    if (i == n)
+    {
+        return 1;
+    }
+    if (i > 1)
+    {
+        return 0;
+    }
+
+    for (i = 1; i < n && cmpfunc(array[i - 1], array[i]) >= 0; i++)
+        ;
+    if (i < n)
+    {
+        return 0;
+    }
+    for (i = 0; i < n / 2; i++)
+    {
+        swap(array, i, n - 1 - i);
+    }
+    return 1;
+}
+
+void sort_array(void **array, int n, cmpfunc_t cmpfunc)
+{
+    int depth = 0;
+    int m;
+
+    if (n < 2 || presorted(array, n, cmpfunc))
+    {
+        return;
+    }
+
+    for (m = n; m > 1; m >>= 1)
+    {
+        depth += 2;
+    }
+    introsort(array, 0, n, depth, cmpfunc);
+}
+
+int sort_unique(void **array, int n, cmpfunc_t cmpfunc)
+{
+    int i, k;
+
+    if (n < 2)
+    {
+        return n;
+    }
+
+    sort_array(array, n, cmpfunc);
+    for (i = 1, k = 1; i < n; i++)
+    {
+        if (cmpfunc(array[k - 1], array[i]) != 0)
+        {
+            array[k++] = array[i];
+        }
+    }
+    return k;
+}
+
+/*
+ * Restores the min-heap property below index i of the merge heap.
+ * The heap holds indices of input arrays, keyed by the element at
+ * each array's current position.
+ */
+static void siftmerge(int *heap, int i, int n, void ***arrays, int *pos,
+                      cmpfunc_t cmpfunc)
+{
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        int tmp;
+
+        if (child >= n)
+        {
+            return;
+        }
+        if (child + 1 < n &&
+            cmpfunc(arrays[heap[child + 1]][pos[heap[child + 1]]],
+                    arrays[heap[child]][pos[heap[child]]]) < 0)
+        {
+            child++;
+        }
+        if (cmpfunc(arrays[heap[i]][pos[heap[i]]],
+                    arrays[heap[child]][pos[heap[child]]]) <= 0)
+        {
+            return;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+int sort_mergeunique(void ***arrays, int *sizes, int k, void **out,
+                     cmpfunc_t cmpfunc)
+{
+    int *heap = malloc((k + 1) * sizeof(int));
+    int *pos = malloc((k + 1) * sizeof(int));
+    int i, n = 0, heapsize = 0;
+
+    if (heap == NULL || pos == NULL)
+    {
+        free(heap);
+        free(pos);
+        return -1;
+    }
+
+    for (i = 0; i < k; i++)
+    {
+        pos[i] = 0;
+        if (sizes[i] > 0)
+        {
+            heap[heapsize++] = i;
+        }
+    }
+    for (i = heapsize / 2 - 1; i >= 0; i--)
+    {
+        siftmerge(heap, i, heapsize, arrays, pos, cmpfunc);
+    }
+
+    while (heapsize > 0)
+    {
+        int top = heap[0];
+        void *elem = arrays[top][pos[top]];
+
+        if (n == 0 || cmpfunc(out[n - 1], elem) != 0)
+        {
+            out[n++] = elem;
+        }
+        if (++pos[top] == sizes[top])
+        {
+            heap[0] = heap[--heapsize];
+        }
+        siftmerge(heap, 0, heapsize, arrays, pos, cmpfunc);
+    }
+
+    free(heap);
+    free(pos);
+    return n;
+}
+
+/*
+ * Returns the index of the first element at or after index lo in the
+ * sorted array[0..n) that is not smaller than elem, or n if there is
+ * none.  Probes lo, lo + 1, lo + 3, lo + 7, ... until it passes elem,
+ * and then binary searches the last gap, so the cost is logarithmic
+ * in the distance moved rather than in n.
+ */
+static int gallop(void **array, int lo, int n, void *elem, cmpfunc_t cmpfunc)
+{
+    int bound = 1, hi;
+
+    while (lo + bound - 1 < n && cmpfunc(array[lo + bound - 1], elem) < 0)
+    {
+        bound *= 2;
+    }
+    hi = lo + bound - 1 < n ? lo + bound - 1 : n;
+    lo += bound / 2;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (cmpfunc(array[mid], elem) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int sort_intersect(void **a, int na, void **b, int nb, void **out, int stop,
+                   cmpfunc_t cmpfunc)
+{
+    int i = 0, j = 0, count = 0;
+
+    if ((long)na * GALLOP_RATIO <= nb)
+    {
+        /* a is small: find each of its elements in b */
+        for (i = 0; i < na; i++)
+        {
+            j = gallop(b, j, nb, a[i], cmpfunc);
+            if (j == nb)
+            {
+                break;
+            }
+            if (cmpfunc(a[i], b[j]) == 0)
+            {
+                if (out != NULL)
+                {
+                    out[count] = a[i];
+                }
+                count++;
+                if (stop)
+                {
+                    break;
+                }
+                j++;
+            }
+        }
+    }
+    else if ((long)nb * GALLOP_RATIO <= na)
+    {
+        /* b is small: find each of its elements in a */
+        for (j = 0; j < nb; j++)
+        {
+            i = gallop(a, i, na, b[j], cmpfunc);
+            if (i == na)
+            {
+                break;
+            }
+            if (cmpfunc(a[i], b[j]) == 0)
+            {
+                if (out != NULL)
+                {
+                    out[count] = a[i];
+                }
+                count++;
+                if (stop)
+                {
+                    break;
+                }
+                i++;
+            }
+        }
+    }
+    else
+    {
+        while (i < na && j < nb)
+        {
+            int cmp = cmpfunc(a[i], b[j]);
+
+            if (cmp < 0)
+            {
+                i++;
+            }
+            else if (cmp > 0)
+            {
+                j++;
+            }
+            else
+            {
+                if (out != NULL)
+                {
+                    out[count] = a[i];
+                }
+                count++;
+                if (stop)
+                {
+                    break;
+                }
+                i++;
+                j++;
+            }
+        }
+    }
+    return count;
+}
+
+int sort_subtract(void **a, int na, void **b, int nb, void **out,
+                  cmpfunc_t cmpfunc)
+{
+    int skip = (long)na * GALLOP_RATIO <= nb;
+    int i, j = 0, count = 0;
+
+    /* Every element of a must be checked, but b can be skipped */
+    for (i = 0; i < na; i++)
+    {
+        if (skip)
+        {
+            j = gallop(b, j, nb, a[i], cmpfunc);
+        }
+        else
+        {
+            while (j < nb && cmpfunc(b[j], a[i]) < 0)
+            {
+                j++;
+            }
+        }
+        if (j == nb || cmpfunc(a[i], b[j]) != 0)
+        {
+            out[count++] = a[i];
+        }
+    }
+    return count;
+}
@@ -0,0 +1,69 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include "common.h"
+
+/*
+ * Sorts the n elements of the given array of pointers in ascending
+ * order, using the given comparison function to order them.
+ *
+ * The sort is an introsort: quicksort with a median-of-three pivot,
+ * insertion sort for small ranges, and a heapsort fallback that bounds
+ * the worst case at O(n log n).  Input that is already sorted, or
+ * sorted in reverse, is detected in a single linear pass.
+ */
+void sort_array(void **array, int n, cmpfunc_t cmpfunc);
+
+/*
+ * Sorts the n elements of the given array as sort_array does, and then
+ * removes duplicates (elements that compare equal) in a single pass.
+ * The unique elements are left in array[0..k), in ascending order.
+ *
+ * Returns k, the number of unique elements.
+ */
+int sort_unique(void **array, int n, cmpfunc_t cmpfunc);
+
+/*
+ * Merges k sorted arrays into out, dropping duplicates.  arrays[i]
+ * holds sizes[i] elements in ascending order.  out must have room for
+ * the sum of the sizes.
+ *
+ * The merge uses a binary heap over the heads of the arrays, so it
+ * costs O(N log k) comparisons for N elements in total.
+ *
+ * Returns the number of elements written to out, or -1 if memory
+ * could not be allocated.
+ */
+int sort_mergeunique(void ***arrays, int *sizes, int k, void **out,
+                     cmpfunc_t cmpfunc);
+
+/*
+ * Intersects the sorted, duplicate-free arrays a (na elements) and
+ * b (nb elements).  The elements of a that are also in b are written
+ * to out in ascending order, unless out is NULL.  out may be a itself,
+ * which intersects a in place.  If stop is set, returns as soon as one
+ * common element is found.
+ *
+ * When the sizes are similar this is a linear merge.  When one array
+ * is much smaller than the other, each of its elements is located in
+ * the larger one by galloping (exponential search followed by binary
+ * search), so the cost is O(m log(n/m)) for sizes m < n instead of
+ * O(m + n).
+ *
+ * Returns the number of common elements.
+ */
+int sort_intersect(void **a, int na, void **b, int nb, void **out, int stop,
+                   cmpfunc_t cmpfunc);
+
+/*
+ * Subtracts the sorted, duplicate-free array b (nb elements) from
+ * a (na elements): the elements of a that are not in b are written to
+ * out in ascending order.  out may be a itself.  Like sort_intersect,
+ * this gallops through b when a is much smaller.
+ *
+ * Returns the number of elements written.
+ */
+int sort_subtract(void **a, int na, void **b, int nb, void **out,
+                  cmpfunc_t cmpfunc);
+
+#endif
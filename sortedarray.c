@@ -0,0 +1,698 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "set.h"
+#include "sort.h"
+
+
+#define MAXIMUM_ITEMS 100
+
+/*
+ * The type of sets.
+ *
+ * The elements are kept in a contiguous array in ascending order at
+ * all times, so lookups are binary searches, iteration is already
+ * sorted, and union, intersection and difference are single merge
+ * passes over the two inputs.
+ */
+struct set
+{
+    void **array;
+    cmpfunc_t cmpfunc;
+    int num_items;
+    int max_items;
+};
+
+struct set_iter
+{
+    set_t *set;
+    int current;
+};
+
+/*
+ * Returns the index of the first element at or after index lo in the
+ * given set that is not smaller than elem.  *found is set to 1 if that
+ * element is equal to elem, and 0 otherwise.
+ */
+static int searchfrom(set_t *set, int lo, void *elem, int *found)
+{
+    int hi = set->num_items;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (set->cmpfunc(set->array[mid], elem) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    *found = lo < set->num_items && set->cmpfunc(set->array[lo], elem) == 0;
+    return lo;
+}
+
+/*
+ * Searches the whole set; see searchfrom.
+ */
+static int search(set_t *set, void *elem, int *found)
+{
+    return searchfrom(set, 0, elem, found);
+}
+
+/*
+ * Makes room for at least num_items elements in the given set.
+ * Returns 1 on success, and 0 if the allocation failed.
+ */
+static int reserve(set_t *set, int num_items)
+{
+    int max_items = set->max_items;
+    void **array;
+
+    if (num_items <= max_items)
+    {
+        return 1;
+    }
+    while (max_items < num_items)
+    {
+        max_items *= 2;
+    }
+    array = realloc(set->array, max_items * sizeof(void *));
+    if (array == NULL)
+    {
+        return 0;
+    }
+    set->array = array;
+    set->max_items = max_items;
+    return 1;
+}
+
+/*
+ * Creates an empty set with room for num_items elements.
+ */
+static set_t *createsized(cmpfunc_t cmpfunc, int num_items)
+{
+    set_t *set = malloc(sizeof(set_t));
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    set->cmpfunc = cmpfunc;
+    set->num_items = 0;
+    set->max_items = num_items > MAXIMUM_ITEMS ? num_items : MAXIMUM_ITEMS;
+    set->array = malloc(set->max_items * sizeof(void *));
+    if (set->array == NULL)
+    {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Creates a new set using the given comparison function
+ * to compare elements of the set.
+ */
+set_t *set_create(cmpfunc_t cmpfunc)
+{
+    return createsized(cmpfunc, MAXIMUM_ITEMS);
+}
+
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set.  This implementation does not hash its
+ * elements, so the hash function is ignored.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc)
+{
+    return set_create(cmpfunc);
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  They
+ * are copied straight into the set's array, then sorted and
+ * deduplicated in place.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    set_t *set = createsized(cmpfunc, n);
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(set->array, elems, n * sizeof(void *));
+    set->num_items = sort_unique(set->array, n, cmpfunc);
+    return set;
+}
+
+/*
+ * Creates a new set holding the elements of the given list.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list)
+{
+    set_t *set = createsized(cmpfunc, list_size(list));
+    list_iter_t *iter;
+    int n = 0;
+
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    iter = list_createiter(list);
+    while (list_hasnext(iter))
+    {
+        set->array[n++] = list_next(iter);
+    }
+    list_destroyiter(iter);
+
+    set->num_items = sort_unique(set->array, n, cmpfunc);
+    return set;
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  This
+ * implementation does not hash its elements, so the hash function is
+ * ignored.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n)
+{
+    return set_create_from_array(cmpfunc, elems, n);
+}
+
+/*
+ * Creates a new set holding the elements of the given list, ignoring
+ * the hash function as above.
+ */
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list)
+{
+    return set_create_from_list(cmpfunc, list);
+}
+
+/*
+ * Destroys the given set.  Subsequently accessing the set
+ * will lead to undefined behavior.
+ */
+void set_destroy(set_t *set)
+{
+    free(set->array);
+    free(set);
+}
+
+/*
+ * Returns the size (cardinality) of the given set.
+ */
+int set_size(set_t *set)
+{
+    return set->num_items;
+}
+
+/*
+ * Adds the given element to the given set.
+ */
+void set_add(set_t *set, void *elem)
+{
+    int found, pos;
+
+    /* Appending in order is the common case when copying sorted data */
+    if (set->num_items == 0 ||
+        set->cmpfunc(set->array[set->num_items - 1], elem) < 0)
+    {
+        pos = set->num_items;
+    }
+    else
+    {
+        pos = search(set, elem, &found);
+        if (found)
+        {
+            return;
+        }
+    }
+
+    if (!reserve(set, set->num_items + 1))
+    {
+        return;
+    }
+    memmove(&set->array[pos + 1], &set->array[pos],
+            (set->num_items - pos) * sizeof(void *));
+    set->array[pos] = elem;
+    set->num_items++;
+}
+
+/*
+ * Merges the n sorted, distinct elements at elems into the given set.
+ *
+ * The array of the set is grown to fit both, and the two are merged
+ * from the back, so nothing is overwritten before it has been read.
+ * Duplicates leave a gap between the untouched front of the set and
+ * the merged tail, which is closed with one memmove.  Growing doubles
+ * the array, so repeated small merges do not copy the set each time.
+ *
+ * Returns 1 on success, and 0 if the allocation failed, in which case
+ * the set is unchanged.
+ */
+static int mergeinto(set_t *set, void **elems, int n)
+{
+    int total = set->num_items + n;
+    int i = set->num_items - 1, j = n - 1, w = total;
+
+    if (!reserve(set, total))
+    {
+        return 0;
+    }
+
+    while (j >= 0)
+    {
+        int cmp = i >= 0 ? set->cmpfunc(set->array[i], elems[j]) : -1;
+
+        if (cmp >= 0)
+        {
+            set->array[--w] = set->array[i--];
+            if (cmp == 0)
+            {
+                j--;
+            }
+        }
+        else
+        {
+            set->array[--w] = elems[j--];
+        }
+    }
+
+    if (w > i + 1)
+    {
+        memmove(&set->array[i + 1], &set->array[w],
+                (total - w) * sizeof(void *));
+    }
+    set->num_items = i + 1 + total - w;
+    return 1;
+}
+
+/*
+ * Adds the n elements of the given array to the given set.
+ *
+ * The batch is sorted and deduplicated, and then merged into the
+ * array of the set in place (see mergeinto).
+ */
+int set_add_batch(set_t *set, void **elems, int n)
+{
+    void **batch;
+    int ok;
+
+    if (n == 0)
+    {
+        return 1;
+    }
+    batch = malloc(n * sizeof(void *));
+    if (batch == NULL)
+    {
+        return 0;
+    }
+    memcpy(batch, elems, n * sizeof(void *));
+    ok = mergeinto(set, batch, sort_unique(batch, n, set->cmpfunc));
+    free(batch);
+    return ok;
+}
+
+/*
+ * Returns 1 if the given element is contained in
+ * the given set, 0 otherwise.
+ */
+int set_contains(set_t *set, void *elem)
+{
+    int found;
+
+    search(set, elem, &found);
+    return found;
+}
+
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ */
+set_t *set_union(set_t *a, set_t *b)
+{
+    set_t *union_set = createsized(a->cmpfunc, a->num_items + b->num_items);
+    int i = 0, j = 0, n = 0;
+
+    if (union_set == NULL)
+    {
+        return NULL;
+    }
+
+    while (i < a->num_items && j < b->num_items)
+    {
+        int cmp = a->cmpfunc(a->array[i], b->array[j]);
+
+        if (cmp < 0)
+        {
+            union_set->array[n++] = a->array[i++];
+        }
+        else if (cmp > 0)
+        {
+            union_set->array[n++] = b->array[j++];
+        }
+        else
+        {
+            union_set->array[n++] = a->array[i++];
+            j++;
+        }
+    }
+    while (i < a->num_items)
+    {
+        union_set->array[n++] = a->array[i++];
+    }
+    while (j < b->num_items)
+    {
+        union_set->array[n++] = b->array[j++];
+    }
+
+    union_set->num_items = n;
+    return union_set;
+}
+
+/*
+ * Returns the intersection of the two given sets; the
+ * returned set contains all elements that are contained
+ * in both a and b.
+ *
+ * Similar sizes are merged linearly; when one set is much smaller, its
+ * elements are located in the larger one by galloping, so the cost
+ * follows the smaller set.
+ */
+set_t *set_intersection(set_t *a, set_t *b)
+{
+    int max = a->num_items < b->num_items ? a->num_items : b->num_items;
+    set_t *intersection_set = createsized(a->cmpfunc, max);
+
+    if (intersection_set == NULL)
+    {
+        return NULL;
+    }
+
+    intersection_set->num_items = sort_intersect(a->array, a->num_items,
+                                                 b->array, b->num_items,
+                                                 intersection_set->array, 0,
+                                                 a->cmpfunc);
+    return intersection_set;
+}
+
+/*
+ * Returns the set difference of the two given sets; the
+ * returned set contains all elements that are contained
+ * in a and not in b.
+ */
+set_t *set_difference(set_t *a, set_t *b)
+{
+    set_t *difference_set = createsized(a->cmpfunc, a->num_items);
+    int i = 0, j = 0, n = 0;
+
+    if (difference_set == NULL)
+    {
+        return NULL;
+    }
+
+    while (i < a->num_items && j < b->num_items)
+    {
+        int cmp = a->cmpfunc(a->array[i], b->array[j]);
+
+        if (cmp < 0)
+        {
+            difference_set->array[n++] = a->array[i++];
+        }
+        else if (cmp > 0)
+        {
+            j++;
+        }
+        else
+        {
+            i++;
+            j++;
+        }
+    }
+    while (i < a->num_items)
+    {
+        difference_set->array[n++] = a->array[i++];
+    }
+
+    difference_set->num_items = n;
+    return difference_set;
+}
+
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ */
+void set_intersect_inplace(set_t *a, set_t *b)
+{
+    a->num_items = sort_intersect(a->array, a->num_items,
+                                  b->array, b->num_items,
+                                  a->array, 0, a->cmpfunc);
+}
+
+/*
+ * Replaces the contents of a with the union of a and b, merging b
+ * into the array of a in place (see mergeinto).
+ */
+void set_union_inplace(set_t *a, set_t *b)
+{
+    if (a != b)
+    {
+        mergeinto(a, b->array, b->num_items);
+    }
+}
+
+/*
+ * Removes from a every element that is contained in b, compacting
+ * the array of a in place during one merge pass.
+ */
+void set_subtract_inplace(set_t *a, set_t *b)
+{
+    int i = 0, j = 0, n = 0;
+
+    while (i < a->num_items)
+    {
+        int cmp = j < b->num_items ? a->cmpfunc(a->array[i], b->array[j]) : -1;
+
+        if (cmp > 0)
+        {
+            j++;
+            continue;
+        }
+        if (cmp < 0)
+        {
+            a->array[n++] = a->array[i];
+        }
+        else
+        {
+            j++;
+        }
+        i++;
+    }
+    a->num_items = n;
+}
+
+/*
+ * Returns the intersection of the n given sets.
+ *
+ * The smallest set drives the search: each of its elements is looked
+ * up in the other sets and dropped at the first miss.  Since the
+ * elements arrive in ascending order, each lookup only searches the
+ * part of a set after the previous match.
+ */
+set_t *set_intersection_many(set_t **sets, int n)
+{
+    set_t *smallest = sets[0], *result;
+    int *cursors;
+    int i, j;
+
+    for (i = 1; i < n; i++)
+    {
+        if (sets[i]->num_items < smallest->num_items)
+        {
+            smallest = sets[i];
+        }
+    }
+
+    result = createsized(sets[0]->cmpfunc, smallest->num_items);
+    cursors = calloc(n, sizeof(int));
+    if (result == NULL || cursors == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(cursors);
+        return NULL;
+    }
+
+    for (i = 0; i < smallest->num_items; i++)
+    {
+        void *elem = smallest->array[i];
+        int found = 1;
+
+        for (j = 0; j < n && found; j++)
+        {
+            if (sets[j] != smallest)
+            {
+                cursors[j] = searchfrom(sets[j], cursors[j], elem, &found);
+            }
+        }
+        if (found)
+        {
+            result->array[result->num_items++] = elem;
+        }
+    }
+
+    free(cursors);
+    return result;
+}
+
+/*
+ * Returns the union of the n given sets, using a k-way heap merge of
+ * their sorted arrays.
+ */
+set_t *set_union_many(set_t **sets, int n)
+{
+    void ***arrays = malloc(n * sizeof(void **));
+    int *sizes = malloc(n * sizeof(int));
+    set_t *result = NULL;
+    int i, total = 0;
+
+    if (arrays != NULL && sizes != NULL)
+    {
+        for (i = 0; i < n; i++)
+        {
+            arrays[i] = sets[i]->array;
+            sizes[i] = sets[i]->num_items;
+            total += sizes[i];
+        }
+
+        result = createsized(sets[0]->cmpfunc, total);
+        if (result != NULL)
+        {
+            int merged = sort_mergeunique(arrays, sizes, n, result->array,
+                                          result->cmpfunc);
+
+            if (merged < 0)
+            {
+                set_destroy(result);
+                result = NULL;
+            }
+            else
+            {
+                result->num_items = merged;
+            }
+        }
+    }
+
+    free(arrays);
+    free(sizes);
+    return result;
+}
+
+/*
+ * Counts the elements that a and b have in common, merging or
+ * galloping depending on their sizes.  If stop is set, returns as soon
+ * as one common element is found.
+ */
+static int countcommon(set_t *a, set_t *b, int stop)
+{
+    return sort_intersect(a->array, a->num_items, b->array, b->num_items,
+                          NULL, stop, a->cmpfunc);
+}
+
+/*
+ * Returns the number of elements contained in both a and b.
+ */
+int set_intersection_size(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 0);
+}
+
+/*
+ * Returns the number of elements contained in a and not in b.
+ */
+int set_difference_size(set_t *a, set_t *b)
+{
+    return set_size(a) - countcommon(a, b, 0);
+}
+
+/*
+ * Returns 1 if a and b have at least one element in common.
+ */
+int set_intersects(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 1) > 0;
+}
+
+/*
+ * Returns a copy of the given set.
+ */
+set_t *set_copy(set_t *set)
+{
+    set_t *copied_set = createsized(set->cmpfunc, set->num_items);
+    if (copied_set == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(copied_set->array, set->array, set->num_items * sizeof(void *));
+    copied_set->num_items = set->num_items;
+    return copied_set;
+}
+
+/*
+ * Creates a new set iterator for iterating over the given set.
+ * The elements are already sorted, so they are returned in
+ * ascending order without any extra work.
+ */
+set_iter_t *set_createiter(set_t *set)
+{
+    set_iter_t *set_iter = malloc(sizeof(set_iter_t));
+    if (set_iter == NULL)
+    {
+        return NULL;
+    }
+
+    set_iter->set = set;
+    set_iter->current = 0;
+    return set_iter;
+}
+
+/*
+ * Destroys the given set iterator.
+ */
+void set_destroyiter(set_iter_t *iter)
+{
+    free(iter);
+}
+
+/*
+ * Returns 0 if the given set iterator has reached the end of the
+ * set, or 1 otherwise.
+ */
+int set_hasnext(set_iter_t *iter)
+{
+    return iter->current < iter->set->num_items;
+}
+
+/*
+ * Returns the next element in the sequence represented by the given
+ * set iterator.
+ */
+void *set_next(set_iter_t *iter)
+{
+    if (!set_hasnext(iter))
+    {
+        return NULL;
+    }
+    return iter->set->array[iter->current++];
+}
@@ -1,142 +1,1367 @@
 /* Author: Steffen Viken Valvaag <steffenv@cs.uit.no> */
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include "list.h"
 #include "set.h"
+#include "intern.h"
+#include "tokenizer.h"
+#include "model.h"
+#include "bloom.h"
+#include "sort.h"
 #include "common.h"
 
 /*
- * Case-insensitive comparison function for strings.
+ * State for collecting the distinct words of one file at a time.  Each
+ * collector interns tokens in a private table first, whose IDs are
+ * dense, so lastseen can be indexed by local ID: a word is a duplicate
+ * within the current file if its entry equals the file's stamp.
+ * Duplicates are dropped as they are tokenized, without any
+ * comparisons, and starting a new file is O(1).
+ *
+ * The collected words are IDs of the shared vocabulary.  globalids
+ * caches the vocabulary ID of each local ID, so the shared table, and
+ * its lock, is only visited the first time a collector sees a word.
+ * Collectors running in different threads thus rarely contend.
  */
-static int compare_words(void *a, void *b)
+typedef struct collector
+{
+	intern_t *vocab;			/* Shared by all collectors */
+	pthread_mutex_t *vocablock;	/* Guards vocab */
+	intern_t *local;			/* Words seen by this collector */
+	bloom_t *filter;			/* If set, only words it may hold are kept */
+	void **words;				/* Distinct vocab IDs of the current file */
+	int n;
+	int max;
+	unsigned int *globalids;	/* Vocab ID of each local ID, or 0 */
+	unsigned int *lastseen;		/* Stamp of the last file each ID was in */
+	unsigned int numseen;		/* Number of entries in lastseen */
+	unsigned int stamp;
+} collector_t;
+
+/*
+ * Creates a collector that interns words in the given table, holding
+ * the given lock while it does so.
+ */
+static collector_t *collector_create(intern_t *vocab,
+									 pthread_mutex_t *vocablock)
+{
+	collector_t *c = malloc(sizeof(collector_t));
+
+	if (c == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	c->vocab = vocab;
+	c->vocablock = vocablock;
+	c->local = intern_create();
+	c->filter = NULL;
+	c->n = 0;
+	c->max = 256;
+	c->words = malloc(c->max * sizeof(void *));
+	c->numseen = 1024;
+	c->globalids = calloc(c->numseen, sizeof(unsigned int));
+	c->lastseen = calloc(c->numseen, sizeof(unsigned int));
+	c->stamp = 0;
+	if (c->local == NULL || c->words == NULL || c->globalids == NULL ||
+		c->lastseen == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	return c;
+}
+
+static void collector_destroy(collector_t *c)
+{
+	intern_destroy(c->local);
+	free(c->words);
+	free(c->globalids);
+	free(c->lastseen);
+	free(c);
+}
+
+/*
+ * Grows the arrays indexed by local ID to hold the given ID, with the
+ * new entries zeroed.
+ */
+static void growseen(collector_t *c, unsigned int id)
+{
+	unsigned int numseen = c->numseen;
+
+	while (id >= numseen)
+	{
+		numseen *= 2;
+	}
+	c->globalids = realloc(c->globalids, numseen * sizeof(unsigned int));
+	c->lastseen = realloc(c->lastseen, numseen * sizeof(unsigned int));
+	if (c->globalids == NULL || c->lastseen == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	memset(c->globalids + c->numseen, 0,
+		   (numseen - c->numseen) * sizeof(unsigned int));
+	memset(c->lastseen + c->numseen, 0,
+		   (numseen - c->numseen) * sizeof(unsigned int));
+	c->numseen = numseen;
+}
+
+/*
+ * Token visitor: interns the token, and collects its ID unless it was
+ * already seen in the current file.
+ */
+static void collect(token_t *token, void *arg)
+{
+	collector_t *c = arg;
+	unsigned int id;
+
+	if (c->filter != NULL &&
+		!bloom_check(c->filter, bloom_hash(token->text, token->len)))
+	{
+		return;
+	}
+	id = intern_foldedn(c->local, token->text, token->len);
+	if (id == 0)
+	{
+		fatal_error("out of memory");
+	}
+	if (id >= c->numseen)
+	{
+		growseen(c, id);
+	}
+	if (c->lastseen[id] == c->stamp)
+	{
+		return;
+	}
+	c->lastseen[id] = c->stamp;
+
+	/* First time this collector sees the word; look it up for good */
+	if (c->globalids[id] == 0)
+	{
+		pthread_mutex_lock(c->vocablock);
+		c->globalids[id] = intern_foldedn(c->vocab, token->text, token->len);
+		pthread_mutex_unlock(c->vocablock);
+		if (c->globalids[id] == 0)
+		{
+			fatal_error("out of memory");
+		}
+	}
+
+	if (c->n == c->max)
+	{
+		c->max *= 2;
+		c->words = realloc(c->words, c->max * sizeof(void *));
+		if (c->words == NULL)
+		{
+			fatal_error("out of memory");
+		}
+	}
+	c->words[c->n++] = INTERN_ELEM(c->globalids[id]);
+}
+
+/*
+ * Adds the distinct words of the given file to the given set, as IDs
+ * from the collector's vocabulary.  Tokens go straight from the
+ * mapped file through the intern tables into the collector, which drops
+ * duplicates on the spot, and the set then gets each word once in a
+ * single batch.
+ */
+static void tokenize_into_set(char *filename, set_t *set, collector_t *c)
 {
-    return strcasecmp(a, b);
+	tokenizer_t *tokenizer = tokenizer_open(filename);
+
+	if (tokenizer == NULL) 
+	{
+		perror("open");
+		fatal_error("tokenizer_open() failed");
+	}
+
+	/* A new stamp marks every ID as unseen; on wraparound, reset */
+	if (++c->stamp == 0)
+	{
+		memset(c->lastseen, 0, c->numseen * sizeof(unsigned int));
+		c->stamp = 1;
+	}
+	c->n = 0;
+	tokenizer_foreach(tokenizer, collect, c);
+	tokenizer_close(tokenizer);
+	if (!set_add_batch(set, c->words, c->n))
+	{
+		fatal_error("out of memory");
+	}
 }
 
 /*
- * Returns the set of (unique) words found in the given file.
+ * Returns the set of (unique) words found in the given file, as IDs
+ * from the collector's vocabulary.
  */
-static set_t *tokenize(char *filename)
+static set_t *tokenize(char *filename, collector_t *c)
 {
-	set_t *wordset = set_create(compare_words);
-	list_t *wordlist = list_create(compare_words);
+	set_t *wordset = set_createhash(compare_ids, hash_id);
+
+	if (wordset == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	tokenize_into_set(filename, wordset, c);
+	return wordset;
+}
+
+/*
+ * Runs task(i, worker, arg) for every i from 0 to ntasks - 1, on
+ * nthreads threads, including the calling one.  Tasks are handed out
+ * one at a time, so threads that get cheap tasks take more of them.
+ * worker is the number of the thread running the task, from 0 to
+ * nthreads - 1, for state that must not be shared between threads.
+ */
+typedef void (*taskfunc_t)(int i, int worker, void *arg);
+
+typedef struct work
+{
+	taskfunc_t task;
+	void *arg;
+	int ntasks;
+	int next;					/* Next task to hand out */
+	pthread_mutex_t lock;		/* Guards next */
+} work_t;
+
+typedef struct worker
+{
+	work_t *work;
+	int worker;
+	pthread_t thread;
+} worker_t;
+
+static void *runtasks(void *arg)
+{
+	worker_t *w = arg;
+	work_t *work = w->work;
+	int i;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&work->lock);
+		i = work->next++;
+		pthread_mutex_unlock(&work->lock);
+		if (i >= work->ntasks)
+		{
+			break;
+		}
+		work->task(i, w->worker, work->arg);
+	}
+	return NULL;
+}
+
+static void parallel_for(int nthreads, int ntasks, taskfunc_t task, void *arg)
+{
+	work_t work;
+	worker_t *workers;
+	int i;
+
+	if (nthreads > ntasks)
+	{
+		nthreads = ntasks;
+	}
+	if (nthreads <= 1)
+	{
+		for (i = 0; i < ntasks; i++)
+		{
+			task(i, 0, arg);
+		}
+		return;
+	}
+
+	workers = malloc(nthreads * sizeof(worker_t));
+	if (workers == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	work.task = task;
+	work.arg = arg;
+	work.ntasks = ntasks;
+	work.next = 0;
+	pthread_mutex_init(&work.lock, NULL);
+	for (i = 0; i < nthreads; i++)
+	{
+		workers[i].work = &work;
+		workers[i].worker = i;
+	}
+
+	/* The tasks of a thread that fails to start are taken by the rest */
+	for (i = 1; i < nthreads; i++)
+	{
+		if (pthread_create(&workers[i].thread, NULL, runtasks,
+						   &workers[i]) != 0)
+		{
+			break;
+		}
+	}
+	runtasks(&workers[0]);
+	while (--i > 0)
+	{
+		pthread_join(workers[i].thread, NULL);
+	}
+	pthread_mutex_destroy(&work.lock);
+	free(workers);
+}
+
+/*
+ * Arguments of the tasks of tokenize_dir.
+ */
+typedef struct dirjob
+{
+	char **files;
+	set_t **sets;				/* Input sets of a reduction round */
+	set_t **out;				/* Output sets of a reduction round */
+	int n;						/* Number of input sets */
+	set_t *(*combine)(set_t **, int);
+	collector_t **collectors;	/* One per worker */
+} dirjob_t;
+
+/*
+ * Task: tokenizes file i.
+ */
+static void tokenizetask(int i, int worker, void *arg)
+{
+	dirjob_t *job = arg;
+
+	job->sets[i] = tokenize(job->files[i], job->collectors[worker]);
+}
+
+/*
+ * Task: combines input sets 2i and 2i + 1 into output set i.  With an
+ * odd number of inputs, the last one is passed on as it is.
+ */
+static void reducetask(int i, int worker, void *arg)
+{
+	dirjob_t *job = arg;
+	set_t **pair = job->sets + 2 * i;
+
+	(void)worker;
+	if (2 * i + 1 == job->n)
+	{
+		job->out[i] = pair[0];
+		return;
+	}
+	job->out[i] = job->combine(pair, 2);
+	set_destroy(pair[0]);
+	set_destroy(pair[1]);
+}
+
+/*
+ * Tokenizes every file in the given directory, and combines the
+ * resulting word sets with the given n-way set operation, using one
+ * collector for each of nthreads threads.  The number of files is
+ * stored in *nfiles.
+ *
+ * With one thread, all sets are combined in one pass.  Otherwise the
+ * files are tokenized in parallel, and the sets are combined pairwise
+ * in a tree, each level in parallel.  Since the operation is
+ * associative and commutative, the result is the same either way.
+ */
+static set_t *tokenize_dir(char *dir, set_t *(*combine)(set_t **, int),
+						   collector_t **collectors, int nthreads,
+						   int *nfiles)
+{
+	list_t *files = find_files(dir);
 	list_iter_t *it;
-	FILE *f;
-	
-	f = fopen(filename, "r");
-	if (f == NULL) 
+	dirjob_t job;
+	set_t *result;
+	int i, n = 0;
+
+	job.files = malloc((list_size(files) + 1) * sizeof(char *));
+	job.sets = malloc((list_size(files) + 1) * sizeof(set_t *));
+	job.out = malloc((list_size(files) + 1) * sizeof(set_t *));
+	if (job.files == NULL || job.sets == NULL || job.out == NULL)
 	{
-		perror("fopen");
-		fatal_error("fopen() failed");
+		fatal_error("out of memory");
 	}
-	tokenize_file(f, wordlist);
-	
-	it = list_createiter(wordlist);
-	while (list_hasnext(it)) 
+	it = list_createiter(files);
+	while (list_hasnext(it))
 	{
-		set_add(wordset, list_next(it));		
+		job.files[n++] = list_next(it);
 	}
 	list_destroyiter(it);
-	list_destroy(wordlist);
-	return wordset;
+	job.n = n;
+	job.combine = combine;
+	*nfiles = n;
+	job.collectors = collectors;
+
+	parallel_for(nthreads, n, tokenizetask, &job);
+	list_destroy(files);
+
+	if (n == 0)
+	{
+		result = set_createhash(compare_ids, hash_id);
+	}
+	else if (nthreads <= 1)
+	{
+		result = combine(job.sets, n);
+		for (i = 0; i < n; i++)
+		{
+			set_destroy(job.sets[i]);
+		}
+	}
+	else
+	{
+		while (job.n > 1)
+		{
+			set_t **tmp;
+
+			parallel_for(nthreads, (job.n + 1) / 2, reducetask, &job);
+			job.n = (job.n + 1) / 2;
+			tmp = job.sets;
+			job.sets = job.out;
+			job.out = tmp;
+		}
+		result = job.sets[0];
+	}
+	free(job.files);
+	free(job.sets);
+	free(job.out);
+	return result;
 }
 
 /*
- * Prints a set of words.
+ * The type of functions that count the trigger words of a file, for
+ * classify_dir.  worker is as for parallel_for.
  */
-static void printwords(char *prefix, set_t *words)
+typedef int (*countfunc_t)(char *file, int worker, void *arg);
+
+/*
+ * Arguments of the tasks of classify_dir.  Results are written in the
+ * order of files, whatever order they are found in: each one waits in
+ * counts until every file before it has been written.
+ */
+typedef struct mailjob
 {
-	set_iter_t *it;
-	
-	it = set_createiter(words);
-	printf("%s: ", prefix);
-	while (set_hasnext(it)) 
+	char **files;
+	int *counts;				/* Number of trigger words of each file */
+	char *done;					/* Whether each count is ready */
+	int nextout;				/* First file not yet written */
+	pthread_mutex_t lock;		/* Guards done and nextout */
+	countfunc_t count;
+	void *arg;
+} mailjob_t;
+
+/*
+ * Writes the verdict on the given file.
+ */
+static void printresult(char *file, int nspamwords)
+{
+	printf("%s has %d spamwords(s)", file, nspamwords);
+	if(nspamwords > 0)
+	{
+		printf(" = spam");
+
+	}
+	else
 	{
-		printf(" %s", set_next(it));
+		printf(" = not spam");
 	}
 	printf("\n");
+}
+
+/*
+ * Task: classifies file i, then writes every result that is due.
+ */
+static void classifytask(int i, int worker, void *arg)
+{
+	mailjob_t *job = arg;
+
+	job->counts[i] = job->count(job->files[i], worker, job->arg);
+
+	pthread_mutex_lock(&job->lock);
+	job->done[i] = 1;
+	while (job->done[job->nextout])
+	{
+		printresult(job->files[job->nextout], job->counts[job->nextout]);
+		job->nextout++;
+	}
+	pthread_mutex_unlock(&job->lock);
+}
+
+/*
+ * Classifies every file in the given directory by its number of
+ * trigger words, as counted by count with the given argument, on
+ * nthreads threads.  The results are written in the order the files
+ * were found, as a sequential run would.
+ */
+static void classify_dir(char *dir, countfunc_t count, void *arg,
+						 int nthreads)
+{
+	list_t *files = find_files(dir);
+	list_iter_t *it;
+	mailjob_t job;
+	int n = 0;
+
+	job.files = malloc((list_size(files) + 1) * sizeof(char *));
+	job.counts = malloc((list_size(files) + 1) * sizeof(int));
+	job.done = calloc(list_size(files) + 1, 1);
+	if (job.files == NULL || job.counts == NULL || job.done == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	it = list_createiter(files);
+	while (list_hasnext(it))
+	{
+		job.files[n++] = list_next(it);
+	}
+	list_destroyiter(it);
+	job.nextout = 0;
+	job.count = count;
+	job.arg = arg;
+	pthread_mutex_init(&job.lock, NULL);
+
+	parallel_for(nthreads, n, classifytask, &job);
+
+	pthread_mutex_destroy(&job.lock);
+	list_destroy(files);
+	free(job.files);
+	free(job.counts);
+	free(job.done);
+}
+
+/*
+ * Trigger words as a set of IDs, for counting with countinset.
+ */
+typedef struct setcount
+{
+	set_t *triggerwords;
+	collector_t **collectors;	/* One per worker */
+} setcount_t;
+
+/*
+ * Counts the trigger words of a file against a set.
+ */
+static int countinset(char *file, int worker, void *arg)
+{
+	setcount_t *sc = arg;
+	set_t *file_words = tokenize(file, sc->collectors[worker]);
+	/* Only the count is needed, so no intersection set is built */
+	int nspamwords = set_intersection_size(file_words, sc->triggerwords);
+
+	set_destroy(file_words);
+	return nspamwords;
+}
+
+/*
+ * State for counting the distinct trigger words of one file at a time
+ * against a model.  Like a collector, but since the words of a model
+ * are numbered densely, lastseen is indexed by word number, and no
+ * intern table is needed.
+ */
+typedef struct matcher
+{
+	model_t *model;
+	unsigned int *lastseen;		/* Stamp of the last file each word was in */
+	unsigned int stamp;
+	int count;					/* Distinct trigger words so far */
+} matcher_t;
+
+static matcher_t *matcher_create(model_t *model)
+{
+	matcher_t *m = malloc(sizeof(matcher_t));
+
+	if (m == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	m->model = model;
+	m->lastseen = calloc(model_count(model, MODEL_TRIGGERS) + 1,
+						 sizeof(unsigned int));
+	m->stamp = 0;
+	m->count = 0;
+	if (m->lastseen == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	return m;
+}
+
+static void matcher_destroy(matcher_t *m)
+{
+	free(m->lastseen);
+	free(m);
+}
+
+/*
+ * Token visitor: counts the token if it is a trigger word not already
+ * seen in the current file.
+ */
+static void match(token_t *token, void *arg)
+{
+	matcher_t *m = arg;
+	int i = model_find(m->model, MODEL_TRIGGERS, token->text, token->len);
+
+	if (i >= 0 && m->lastseen[i] != m->stamp)
+	{
+		m->lastseen[i] = m->stamp;
+		m->count++;
+	}
+}
+
+/*
+ * Returns the number of distinct trigger words among the remaining
+ * tokens of the given tokenizer.
+ */
+static int countmatches(matcher_t *m, tokenizer_t *tokenizer)
+{
+	if (++m->stamp == 0)
+	{
+		memset(m->lastseen, 0, (model_count(m->model, MODEL_TRIGGERS) + 1) *
+			   sizeof(unsigned int));
+		m->stamp = 1;
+	}
+	m->count = 0;
+	tokenizer_foreach(tokenizer, match, m);
+	return m->count;
+}
+
+/*
+ * Counts the trigger words of a file against a model.  arg holds one
+ * matcher per worker.
+ */
+static int countinmodel(char *file, int worker, void *arg)
+{
+	matcher_t *m = ((matcher_t **)arg)[worker];
+	tokenizer_t *tokenizer = tokenizer_open(file);
+	int nspamwords;
+
+	if (tokenizer == NULL) 
+	{
+		perror("open");
+		fatal_error("tokenizer_open() failed");
+	}
+	nspamwords = countmatches(m, tokenizer);
+	tokenizer_close(tokenizer);
+	return nspamwords;
+}
+
+/*
+ * The outcome of training: the trigger words, the sets they are
+ * derived from, and the number of files behind each.
+ */
+typedef struct training
+{
+	set_t *spamwords;			/* Words found in every spam file */
+	set_t *nonspam;				/* Words found in any nonspam file */
+	set_t *triggerwords;		/* Spam words that are not nonspam words */
+	int numspam;
+	int numnonspam;
+} training_t;
+
+/*
+ * Trains on the given directories.
+ */
+static void train(char *spamdir, char *nonspamdir, training_t *tr,
+				  collector_t **collectors, int nthreads)
+{
+	tr->spamwords = tokenize_dir(spamdir, set_intersection_many,
+								 collectors, nthreads, &tr->numspam);
+	tr->nonspam = tokenize_dir(nonspamdir, set_union_many, collectors,
+							   nthreads, &tr->numnonspam);
+	tr->triggerwords = set_difference(tr->spamwords, tr->nonspam);
+}
+
+static void training_destroy(training_t *tr)
+{
+	set_destroy(tr->spamwords);
+	set_destroy(tr->nonspam);
+	set_destroy(tr->triggerwords);
+}
+
+/*
+ * Comparison function for lowercase words, in the order of model
+ * files.
+ */
+static int compare_words(void *a, void *b)
+{
+	return strcmp(a, b);
+}
+
+/*
+ * Returns the words of the given set of IDs, sorted as in model files,
+ * and stores their number in *n.
+ */
+static char **sortedwords(set_t *set, intern_t *vocab, int *n)
+{
+	char **words = malloc((set_size(set) + 1) * sizeof(char *));
+	set_iter_t *it;
+
+	if (words == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	*n = 0;
+	it = set_createiter(set);
+	while (set_hasnext(it))
+	{
+		words[(*n)++] = intern_string(vocab, INTERN_ID(set_next(it)));
+	}
 	set_destroyiter(it);
+	sort_array((void **)words, *n, compare_words);
+	return words;
 }
 
+static void writemodel(char *filename, modelspec_t *spec)
+{
+	if (!model_write(filename, spec))
+	{
+		perror(filename);
+		fatal_error("model_write() failed");
+	}
+}
 
+/*
+ * Writes the outcome of training as a model file.
+ */
+static void savemodel(char *filename, training_t *tr, intern_t *vocab)
+{
+	modelspec_t spec;
+	int t;
+
+	spec.numspam = tr->numspam;
+	spec.numnonspam = tr->numnonspam;
+	spec.words[MODEL_TRIGGERS] = sortedwords(tr->triggerwords, vocab,
+											 &spec.n[MODEL_TRIGGERS]);
+	spec.words[MODEL_SPAM] = sortedwords(tr->spamwords, vocab,
+										 &spec.n[MODEL_SPAM]);
+	spec.words[MODEL_NONSPAM] = sortedwords(tr->nonspam, vocab,
+											&spec.n[MODEL_NONSPAM]);
+	writemodel(filename, &spec);
+	for (t = 0; t < MODEL_TABLES; t++)
+	{
+		free(spec.words[t]);
+	}
+}
 
 /*
- * Main entry point.
+ * Folds the files of the given directories into a model file, as if
+ * the model had been trained on them too.  Only the new files are
+ * tokenized.  With S, U and T the spam, nonspam and trigger words of
+ * the model, S' and U' the spam and nonspam words of the new files,
+ * and * for intersection and + for union,
+ *
+ *     S * S' - (U + U') = (T * S') - U'
+ *
+ * so the trigger words are updated from the old ones, and the spam
+ * and nonspam words are merged, all as sorted arrays.  The cost is
+ * linear in the new data and in the size of the model, but does not
+ * depend on how many files the model was trained on before.
  */
-int main(int argc, char **argv)
+static void update_model(char *modelfile, char *spamdir, char *nonspamdir,
+						 intern_t *vocab, collector_t **collectors,
+						 int nthreads)
 {
-	char *spamdir, *nonspamdir, *maildir;
-	
-	if (argc != 4) 
+	model_t *model = model_open(modelfile);
+	training_t tr;
+	modelspec_t spec;
+	char **words[MODEL_TABLES];
+	int n[MODEL_TABLES];
+	char **newspam, **newnonspam;
+	int nnewspam, nnewnonspam, t;
+	void **arrays[2];
+	int sizes[2];
+
+	if (model == NULL)
 	{
-		fprintf(stderr, "usage: %s <spamdir> <nonspamdir> <maildir>\n",
-				argv[0]);
-		return 1;
+		perror(modelfile);
+		fatal_error("model_open() failed");
 	}
-	spamdir = argv[1];
-	nonspamdir = argv[2];
-	maildir = argv[3];
-	
-	list_t *list = find_files("spam");
-	list_iter_t *iter = list_createiter(list); 
-	set_t *spamwords = NULL;
-	while(list_hasnext(iter))
+	train(spamdir, nonspamdir, &tr, collectors, nthreads);
+	newspam = sortedwords(tr.spamwords, vocab, &nnewspam);
+	newnonspam = sortedwords(tr.nonspam, vocab, &nnewnonspam);
+	for (t = 0; t < MODEL_TABLES; t++)
+	{
+		words[t] = model_words(model, t);
+		n[t] = model_count(model, t);
+		if (words[t] == NULL)
+		{
+			fatal_error("out of memory");
+		}
+	}
+
+	/* U + U' */
+	spec.words[MODEL_NONSPAM] = malloc((n[MODEL_NONSPAM] + nnewnonspam + 1) *
+									   sizeof(char *));
+	if (spec.words[MODEL_NONSPAM] == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	arrays[0] = (void **)words[MODEL_NONSPAM];
+	sizes[0] = n[MODEL_NONSPAM];
+	arrays[1] = (void **)newnonspam;
+	sizes[1] = nnewnonspam;
+	spec.n[MODEL_NONSPAM] = sort_mergeunique(arrays, sizes, 2,
+											 (void **)spec.words[MODEL_NONSPAM],
+											 compare_words);
+	if (spec.n[MODEL_NONSPAM] < 0)
+	{
+		fatal_error("out of memory");
+	}
+
+	/* S * S' and T * S' - U'; before any spam files, S is empty, and the
+	 * new spam words are taken as they are */
+	if (model_files(model, 1) == 0)
+	{
+		spec.words[MODEL_SPAM] = newspam;
+		spec.n[MODEL_SPAM] = nnewspam;
+		words[MODEL_TRIGGERS] = realloc(words[MODEL_TRIGGERS],
+										(nnewspam + 1) * sizeof(char *));
+		if (words[MODEL_TRIGGERS] == NULL)
+		{
+			fatal_error("out of memory");
+		}
+		n[MODEL_TRIGGERS] =
+			sort_subtract((void **)newspam, nnewspam,
+						  (void **)spec.words[MODEL_NONSPAM],
+						  spec.n[MODEL_NONSPAM],
+						  (void **)words[MODEL_TRIGGERS], compare_words);
+	}
+	else
+	{
+		spec.words[MODEL_SPAM] = words[MODEL_SPAM];
+		spec.n[MODEL_SPAM] = n[MODEL_SPAM];
+		if (tr.numspam > 0)
+		{
+			spec.n[MODEL_SPAM] =
+				sort_intersect((void **)words[MODEL_SPAM], n[MODEL_SPAM],
+							   (void **)newspam, nnewspam,
+							   (void **)words[MODEL_SPAM], 0, compare_words);
+			n[MODEL_TRIGGERS] =
+				sort_intersect((void **)words[MODEL_TRIGGERS],
+							   n[MODEL_TRIGGERS], (void **)newspam, nnewspam,
+							   (void **)words[MODEL_TRIGGERS], 0,
+							   compare_words);
+		}
+		n[MODEL_TRIGGERS] =
+			sort_subtract((void **)words[MODEL_TRIGGERS], n[MODEL_TRIGGERS],
+						  (void **)newnonspam, nnewnonspam,
+						  (void **)words[MODEL_TRIGGERS], compare_words);
+	}
+	spec.words[MODEL_TRIGGERS] = words[MODEL_TRIGGERS];
+	spec.n[MODEL_TRIGGERS] = n[MODEL_TRIGGERS];
+	spec.numspam = model_files(model, 1) + tr.numspam;
+	spec.numnonspam = model_files(model, 0) + tr.numnonspam;
+
+	/* The old words stay mapped until the new model is in place */
+	writemodel(modelfile, &spec);
+	model_close(model);
+
+	for (t = 0; t < MODEL_TABLES; t++)
+	{
+		free(words[t]);
+	}
+	free(spec.words[MODEL_NONSPAM]);
+	free(newspam);
+	free(newnonspam);
+	training_destroy(&tr);
+}
+
+/*
+ * Returns a Bloom filter of the given set of word IDs.
+ */
+static bloom_t *triggerfilter(set_t *triggerwords, intern_t *vocab)
+{
+	bloom_t *filter = bloom_create(set_size(triggerwords));
+	set_iter_t *it;
+
+	if (filter == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	it = set_createiter(triggerwords);
+	while (set_hasnext(it))
+	{
+		char *word = intern_string(vocab, INTERN_ID(set_next(it)));
+
+		bloom_add(filter, bloom_hash(word, strlen(word)));
+	}
+	set_destroyiter(it);
+	return filter;
+}
+
+/*
+ * Classifies the files of the given directory against a model file.
+ */
+static void classify_model(char *modelfile, char *maildir, int nthreads)
+{
+	model_t *model = model_open(modelfile);
+	matcher_t **matchers;
+	int i;
+
+	if (model == NULL)
 	{
-		char *f =(char *)list_next(iter);
-		set_t *set = tokenize(f);
-		if(spamwords == NULL) 
+		perror(modelfile);
+		fatal_error("model_open() failed");
+	}
+	matchers = malloc(nthreads * sizeof(matcher_t *));
+	if (matchers == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	for (i = 0; i < nthreads; i++)
+	{
+		matchers[i] = matcher_create(model);
+	}
+	classify_dir(maildir, countinmodel, matchers, nthreads);
+	for (i = 0; i < nthreads; i++)
+	{
+		matcher_destroy(matchers[i]);
+	}
+	free(matchers);
+	model_close(model);
+}
+
+/*
+ * How serve tells messages apart.  With FRAME_NUL, each message ends
+ * with a NUL byte, or with the input.  With FRAME_LENGTH, each message
+ * is preceded by a line holding its length in bytes, in decimal.
+ */
+enum
+{
+	FRAME_NUL,
+	FRAME_LENGTH
+};
+
+/*
+ * Messages longer than this are refused, so a bad length, or a missing
+ * NUL, cannot make serve buffer without bound.
+ */
+#define MAX_MESSAGE (64 << 20)
+
+/*
+ * Buffered input of serve.  buf[start..end) has been read, but not
+ * yet taken as a message.
+ */
+typedef struct stream
+{
+	int fd;
+	int eof;
+	char *buf;
+	size_t start;
+	size_t end;
+	size_t max;
+	FILE *out;					/* Where verdicts go */
+} stream_t;
+
+/*
+ * Reads until at least want bytes are buffered, or the input ends.
+ * Verdicts are left in the output buffer while more input is at hand,
+ * and flushed in one batch before a read that would block.  Returns
+ * the number of bytes buffered, which may move them.
+ */
+static size_t fill(stream_t *s, size_t want)
+{
+	while (s->end - s->start < want && !s->eof)
+	{
+		struct pollfd pfd;
+		ssize_t n;
+
+		if (s->start > 0)
+		{
+			memmove(s->buf, s->buf + s->start, s->end - s->start);
+			s->end -= s->start;
+			s->start = 0;
+		}
+		if (s->max < want || s->end == s->max)
+		{
+			while (s->max < want || s->end == s->max)
+			{
+				s->max *= 2;
+			}
+			s->buf = realloc(s->buf, s->max);
+			if (s->buf == NULL)
+			{
+				fatal_error("out of memory");
+			}
+		}
+
+		pfd.fd = s->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 0) == 0)
+		{
+			fflush(s->out);
+		}
+		n = read(s->fd, s->buf + s->end, s->max - s->end);
+		if (n < 0 && errno == EINTR)
 		{
-			spamwords = set;
 			continue;
 		}
-		set_t *new = set_intersection(spamwords, tokenize(f));
+		if (n <= 0)
+		{
+			s->eof = 1;
+		}
+		else
+		{
+			s->end += n;
+		}
+	}
+	return s->end - s->start;
+}
+
+/*
+ * Finds the next message of the given stream, and stores where it is
+ * in *data and *len.  The message stays valid until the next call.
+ * Returns 1 if there was a message, 0 at the end of the input, and -1
+ * if the input is malformed.
+ */
+static int nextmessage(stream_t *s, int framing, char **data, size_t *len)
+{
+	size_t avail, scanned = 0, header = 0, n = 0, i;
+	char *end;
+
+	for (;;)
+	{
+		avail = s->end - s->start;
+		end = memchr(s->buf + s->start + scanned,
+					 framing == FRAME_NUL ? '\0' : '\n', avail - scanned);
+		if (end != NULL)
+		{
+			break;
+		}
+		scanned = avail;
+		if (avail > (framing == FRAME_NUL ? MAX_MESSAGE : 20))
+		{
+			return -1;
+		}
+		if (fill(s, avail + 1) == avail)
+		{
+			/* The input ended; a last message need not have a NUL */
+			if (avail == 0 || framing == FRAME_LENGTH)
+			{
+				return avail == 0 ? 0 : -1;
+			}
+			*data = s->buf + s->start;
+			*len = avail;
+			s->start += avail;
+			return 1;
+		}
+	}
 
-		set_destroy(spamwords);
-		spamwords = new;
+	if (framing == FRAME_NUL)
+	{
+		*data = s->buf + s->start;
+		*len = end - *data;
+		s->start += *len + 1;
+		return 1;
+	}
+
+	/* A length line, of digits only */
+	header = end - (s->buf + s->start) + 1;
+	for (i = 0; i < header - 1; i++)
+	{
+		char c = s->buf[s->start + i];
+
+		if (c < '0' || c > '9' || n > MAX_MESSAGE)
+		{
+			return -1;
+		}
+		n = n * 10 + (c - '0');
+	}
+	if (header == 1 || n > MAX_MESSAGE || fill(s, header + n) < header + n)
+	{
+		return -1;
 	}
+	*data = s->buf + s->start + header;
+	*len = n;
+	s->start += header + n;
+	return 1;
+}
 
-	list_destroyiter(iter);
-	list_destroy(list);
+/*
+ * Classifies the messages read from fd against a model, and writes a
+ * verdict line for each one to out, numbering them from 1.
+ */
+static void serve_stream(int fd, FILE *out, int framing, matcher_t *m)
+{
+	stream_t s;
+	unsigned long seq = 0;
+	char *data;
+	size_t len;
+	int r;
 
-	list_t *nonspamlist = find_files("nonspam");
-	list_iter_t *list_iter = list_createiter(nonspamlist);
-	set_t *nonspam = NULL;
-	while(list_hasnext(list_iter))
+	s.fd = fd;
+	s.eof = 0;
+	s.start = 0;
+	s.end = 0;
+	s.max = 65536;
+	s.buf = malloc(s.max);
+	s.out = out;
+	if (s.buf == NULL)
 	{
-		char *f = (char *) list_next(list_iter);
-		set_t *nset = tokenize(f);
-		if(nonspam == NULL)
+		fatal_error("out of memory");
+	}
+	while ((r = nextmessage(&s, framing, &data, &len)) > 0)
+	{
+		tokenizer_t *tokenizer = tokenizer_openbuf(data, len);
+		int nspamwords;
+
+		if (tokenizer == NULL)
 		{
-			nonspam = nset;
-			continue; 
+			fatal_error("out of memory");
 		}
-		set_t *unin = set_union(nonspam, nset);
-		set_destroy(nonspam);
-		nonspam = unin;
+		nspamwords = countmatches(m, tokenizer);
+		tokenizer_close(tokenizer);
+		fprintf(out, "%lu has %d spamwords(s) = %s\n", ++seq, nspamwords,
+				nspamwords > 0 ? "spam" : "not spam");
 	}
-	
-	list_destroyiter(list_iter);
-	list_destroy(nonspamlist);
+	if (r < 0)
+	{
+		fprintf(out, "error: malformed input\n");
+	}
+	fflush(out);
+	free(s.buf);
+}
 
-	set_t *triggerwords = set_difference(spamwords, nonspam);
+/*
+ * Arguments of the tasks of serve.
+ */
+typedef struct server
+{
+	int listenfd;
+	int framing;
+	matcher_t **matchers;		/* One per worker */
+} server_t;
+
+/*
+ * Task: serves connections on the listening socket, one at a time,
+ * until the process ends.  Every worker accepts on the same socket.
+ */
+static void servetask(int i, int worker, void *arg)
+{
+	server_t *sv = arg;
 
-	list_t *mailfiles = find_files("mail");
-	list_iter_t *mailfileiter = list_createiter(mailfiles);
-	while(list_hasnext(mailfileiter))
+	(void)i;
+	for (;;)
 	{
-		char *file = (char*) list_next(mailfileiter); 
-		set_t *file_words = tokenize(file);
-		set_t *intersect = set_intersection(file_words,triggerwords);
-		printf("%s has %d spamwords(s)", file, set_size(intersect));
-		if(set_size(intersect) > 0)
+		int conn = accept(sv->listenfd, NULL, NULL);
+		FILE *out;
+
+		if (conn < 0)
 		{
-			printf(" = spam");
+			if (errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+			perror("accept");
+			fatal_error("accept() failed");
+		}
+		out = fdopen(dup(conn), "w");
+		if (out != NULL)
+		{
+			serve_stream(conn, out, sv->framing, sv->matchers[worker]);
+			fclose(out);
+		}
+		close(conn);
+	}
+}
+
+/*
+ * Returns a socket listening on the given path, replacing any socket
+ * left there by an earlier run.
+ */
+static int listenunix(char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fatal_error("socket path too long: %s", path);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+	{
+		unlink(path);
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(fd, SOMAXCONN) < 0)
+	{
+		perror(path);
+		fatal_error("cannot listen on socket");
+	}
+	return fd;
+}
+
+/*
+ * Loads a model once, and then classifies messages as they arrive on
+ * stdin, or, given a socket path, on connections to a Unix socket,
+ * served by nthreads threads.
+ */
+static void serve(char *modelfile, char *sockpath, int framing, int nthreads)
+{
+	model_t *model = model_open(modelfile);
+	server_t sv;
+	int i;
+
+	if (model == NULL)
+	{
+		perror(modelfile);
+		fatal_error("model_open() failed");
+	}
+	if (sockpath == NULL)
+	{
+		nthreads = 1;
+	}
+	sv.framing = framing;
+	sv.matchers = malloc(nthreads * sizeof(matcher_t *));
+	if (sv.matchers == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	for (i = 0; i < nthreads; i++)
+	{
+		sv.matchers[i] = matcher_create(model);
+	}
+
+	/* A client that goes away must not take the server with it */
+	signal(SIGPIPE, SIG_IGN);
+	if (sockpath == NULL)
+	{
+		setvbuf(stdout, NULL, _IOFBF, 65536);
+		serve_stream(STDIN_FILENO, stdout, framing, sv.matchers[0]);
+	}
+	else
+	{
+		sv.listenfd = listenunix(sockpath);
+		parallel_for(nthreads, nthreads, servetask, &sv);
+	}
+
+	for (i = 0; i < nthreads; i++)
+	{
+		matcher_destroy(sv.matchers[i]);
+	}
+	free(sv.matchers);
+	model_close(model);
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+			"usage: %s [-j N] <spamdir> <nonspamdir> <maildir>\n"
+			"       %s [-j N] train <spamdir> <nonspamdir> <modelfile>\n"
+			"       %s [-j N] update <modelfile> <spamdir> <nonspamdir>\n"
+			"       %s [-j N] classify <modelfile> <maildir>\n"
+			"       %s [-j N] serve [-l] <modelfile> [<socket>]\n",
+			progname, progname, progname, progname, progname);
+	exit(1);
+}
 
+/*
+ * Main entry point.
+ */
+int main(int argc, char **argv)
+{
+	char *progname = argv[0];
+	intern_t *vocab;
+	pthread_mutex_t vocablock;
+	collector_t **collectors;
+	training_t tr;
+	int i, nthreads = 1;
+	
+	/* -j N trains and classifies with N threads */
+	if (argc > 2 && strcmp(argv[1], "-j") == 0)
+	{
+		nthreads = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if (nthreads < 1)
+	{
+		usage(progname);
+	}
+
+	/* A model is all that classify and serve need */
+	if (argc == 4 && strcmp(argv[1], "classify") == 0)
+	{
+		classify_model(argv[2], argv[3], nthreads);
+		return 0;
+	}
+	if (argc > 2 && strcmp(argv[1], "serve") == 0)
+	{
+		int framing = FRAME_NUL;
+
+		if (strcmp(argv[2], "-l") == 0)
+		{
+			framing = FRAME_LENGTH;
+			argc--;
+			argv++;
 		}
-		else
+		if (argc != 3 && argc != 4)
 		{
-			printf(" = not spam");
+			usage(progname);
 		}
-		printf("\n");
+		serve(argv[2], argc == 4 ? argv[3] : NULL, framing, nthreads);
+		return 0;
+	}
+	if (argc != 4 && !(argc == 5 && (strcmp(argv[1], "train") == 0 ||
+									 strcmp(argv[1], "update") == 0)))
+	{
+		usage(progname);
+	}
+
+	vocab = intern_create();
+	collectors = malloc(nthreads * sizeof(collector_t *));
+	if (vocab == NULL || collectors == NULL)
+	{
+		fatal_error("out of memory");
+	}
+	pthread_mutex_init(&vocablock, NULL);
+	for (i = 0; i < nthreads; i++)
+	{
+		collectors[i] = collector_create(vocab, &vocablock);
+	}
+
+	if (argc == 5 && strcmp(argv[1], "update") == 0)
+	{
+		update_model(argv[2], argv[3], argv[4], vocab, collectors, nthreads);
+	}
+	else if (argc == 5)
+	{
+		train(argv[2], argv[3], &tr, collectors, nthreads);
+		savemodel(argv[4], &tr, vocab);
+		training_destroy(&tr);
+	}
+	else
+	{
+		setcount_t sc;
+		bloom_t *filter;
+
+		train(argv[1], argv[2], &tr, collectors, nthreads);
+
+		/* Sets may sort themselves on first read, but not after that */
+		set_destroyiter(set_createiter(tr.triggerwords));
+		sc.triggerwords = tr.triggerwords;
+		sc.collectors = collectors;
+
+		/* Tokens that cannot be trigger words are not even interned */
+		filter = triggerfilter(tr.triggerwords, vocab);
+		for (i = 0; i < nthreads; i++)
+		{
+			collectors[i]->filter = filter;
+		}
+		classify_dir(argv[3], countinset, &sc, nthreads);
+		bloom_destroy(filter);
+		training_destroy(&tr);
+	}
+
+	for (i = 0; i < nthreads; i++)
+	{
+		collector_destroy(collectors[i]);
 	}
+	free(collectors);
+	pthread_mutex_destroy(&vocablock);
+	intern_destroy(vocab);
 
     return 0;
 }
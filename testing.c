@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "set.h"
+#include "list.h"
 
 #define NUM_TRIES 1
 #define NUM_ITEMS 200
 #define RESULT_DIR "/performancetest/"
+#define NUM_SORT_ITEMS 2000000
 
 int compare_ints(void *a, void *b) {
 	/* Compare function from "assert_set.c. */
@@ -16,6 +20,11 @@ int compare_ints(void *a, void *b) {
 	return (*ia) - (*ib);
 }
 
+unsigned long hash_ints(void *a) {
+	/* Consistent with compare_ints, for backends that hash. */
+	return *(int *)a;
+}
+
 void insertItems(set_t *set, int numItems) {
 	int i;
 	for (i = 0; i < numItems; i++) {
@@ -26,7 +35,7 @@ void insertItems(set_t *set, int numItems) {
 }
 
 set_t *setCreate(int numItems) {
-	set_t *set = set_create(compare_ints);
+	set_t *set = set_createhash(compare_ints, hash_ints);
 	insertItems(set, numItems);
 	return set;
 }
@@ -148,6 +157,29 @@ double setCopyTime(int numTries, int numItems) {
 	return time / numTries;
 }
 
+double setSortTime(int numTries, int numItems) {
+	/* Ordered backends pay for sorting when the first iterator is
+	 * created after a modification, so that is what is timed here. */
+	clock_t startTime, endTime;
+	double time = 0;
+	int i;
+
+	for (i = 0; i < numTries; i++) {
+		set_t *set = setCreate(numItems);
+
+		startTime = clock();
+		set_iter_t *iter = set_createiter(set);
+		endTime = clock();
+
+		time += (double)(endTime - startTime) / CLOCKS_PER_SEC;
+
+		set_destroyiter(iter);
+		setDestroy(set);
+	}
+
+	return time / numTries;
+}
+
 double setIterationTime(int numTries, int numItems) {
 	clock_t startTime, endTime, dt;
 	double time = 0;
@@ -172,6 +204,43 @@ double setIterationTime(int numTries, int numItems) {
 	return time / numTries;
 }
 
+double wallClock(void) {
+	/* clock() adds up the CPU time of all threads, which would hide
+	 * any parallel speedup, so threaded runs are timed by wall clock. */
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double listSortTime(int numTries, int numItems, int numThreads) {
+	double startTime, endTime;
+	double time = 0;
+	int i, j;
+
+	for (i = 0; i < numTries; i++) {
+		list_t *list = list_create(compare_ints);
+		int *items = malloc(numItems * sizeof(int));
+
+		srand(i);
+		for (j = 0; j < numItems; j++) {
+			items[j] = rand();
+			list_addlast(list, &items[j]);
+		}
+
+		startTime = wallClock();
+		list_sort_parallel(list, numThreads);
+		endTime = wallClock();
+
+		time += endTime - startTime;
+
+		list_destroy(list);
+		free(items);
+	}
+
+	return time / numTries;
+}
+
 int main (int argc, char **argv) {
 	
 	double insertTime = insertionTime(NUM_TRIES, NUM_ITEMS);
@@ -179,10 +248,11 @@ int main (int argc, char **argv) {
 	double intersectionTime = setIntersectionTime(NUM_TRIES, NUM_ITEMS);
 	double differenceTime = setDifferanceTime(NUM_TRIES, NUM_ITEMS);
 	double copyTime = setCopyTime(NUM_TRIES, NUM_ITEMS);
+	double sortTime = setSortTime(NUM_TRIES, NUM_ITEMS);
 	double iterationTime = setIterationTime(NUM_TRIES, NUM_ITEMS);
 
 	FILE *fp = NULL;
-	char dir[] = "performancetest/";
+	char dir[64] = "performancetest/";
 	char fileName[] = "arrayresult.csv";
 	strcat(dir, fileName);
 
@@ -196,8 +266,31 @@ int main (int argc, char **argv) {
 	Intersection time: %f\n\
 	Difference time: %f\n\
 	Copy time: %f\n\
+	Sort time: %f\n\
 	Iteration time: %f\n",
-	insertTime, unionTime, intersectionTime, differenceTime, copyTime, iterationTime);
+	insertTime, unionTime, intersectionTime, differenceTime, copyTime,
+	sortTime, iterationTime);
+
+	/* Parallel list sort, doubling the thread count up to the number
+	 * of online cores. */
+	int numCores = sysconf(_SC_NPROCESSORS_ONLN);
+	double baseTime = listSortTime(NUM_TRIES, NUM_SORT_ITEMS, 1);
+	int numThreads;
+
+	fprintf(fp, "\nParallel list sort, %d items:\n", NUM_SORT_ITEMS);
+	fprintf(fp, "	1 thread(s): %f\n", baseTime);
+	for (numThreads = 2; numThreads < 2 * numCores; numThreads *= 2) {
+		if (numThreads > numCores) {
+			numThreads = numCores;
+		}
+		double threadTime = listSortTime(NUM_TRIES, NUM_SORT_ITEMS,
+		                                 numThreads);
+		fprintf(fp, "	%d thread(s): %f (speedup %.2fx)\n", numThreads,
+		        threadTime, baseTime / threadTime);
+		if (numThreads == numCores) {
+			break;
+		}
+	}
 
 	fclose(fp);
 
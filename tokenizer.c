@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tokenizer.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * Bytes are classified BLOCK at a time when the compiler targets SSE2
+ * (16) or AVX2 (32).  Otherwise, and for the last partial block of a
+ * file, one byte at a time.
+ */
+#if defined(__AVX2__)
+#define BLOCK 32
+#elif defined(__SSE2__)
+#define BLOCK 16
+#endif
+
+struct tokenizer
+{
+    char *data;         /* The mapped file, or NULL if it is empty */
+    size_t size;
+    int mapped;         /* Whether data is a mapping of our own */
+    size_t pos;         /* Where the search for the next token starts */
+    char folded[TOKEN_MAX + 32];    /* Lowercased copy of the last
+                                     * token, with room for a block */
+};
+
+/*
+ * Returns 1 if c can be part of a token, and 0 otherwise.
+ */
+static int istokenchar(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '\'' || c == '_';
+}
+
+#ifdef BLOCK
+
+/*
+ * Vector helpers for the chosen width.  Bytes of 0x80 and up compare
+ * as negative, so they never fall within any of the ranges below.
+ */
+#if BLOCK == 32
+typedef __m256i vec_t;
+#define LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define SPLAT(c) _mm256_set1_epi8(c)
+#define OR(a, b) _mm256_or_si256(a, b)
+#define AND(a, b) _mm256_and_si256(a, b)
+#define ADD(a, b) _mm256_add_epi8(a, b)
+#define EQ(a, b) _mm256_cmpeq_epi8(a, b)
+#define GT(a, b) _mm256_cmpgt_epi8(a, b)
+#define MASK(v) ((unsigned int)_mm256_movemask_epi8(v))
+#define ALLBITS 0xffffffffU
+#else
+typedef __m128i vec_t;
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define SPLAT(c) _mm_set1_epi8(c)
+#define OR(a, b) _mm_or_si128(a, b)
+#define AND(a, b) _mm_and_si128(a, b)
+#define ADD(a, b) _mm_add_epi8(a, b)
+#define EQ(a, b) _mm_cmpeq_epi8(a, b)
+#define GT(a, b) _mm_cmpgt_epi8(a, b)
+#define MASK(v) ((unsigned int)_mm_movemask_epi8(v))
+#define ALLBITS 0xffffU
+#endif
+
+/*
+ * Returns true in each byte of x that lies within lo to hi.
+ */
+#define INRANGE(x, lo, hi) AND(GT(x, SPLAT((lo) - 1)), GT(SPLAT((hi) + 1), x))
+
+/*
+ * Returns a mask with bit i set if byte i of the block at p can be part
+ * of a token.  Setting bit 5 maps 'A'-'Z' onto 'a'-'z', so one range
+ * test covers letters of both cases.
+ */
+static unsigned int classify(char *p)
+{
+    vec_t x = LOAD(p);
+    vec_t letter = INRANGE(OR(x, SPLAT(0x20)), 'a', 'z');
+    vec_t digit = INRANGE(x, '0', '9');
+    vec_t other = OR(EQ(x, SPLAT('\'')), EQ(x, SPLAT('_')));
+
+    return MASK(OR(OR(letter, digit), other));
+}
+
+/*
+ * Stores a lowercased copy of the block at p in out.  Returns nonzero
+ * if the block had any uppercase letters.
+ */
+static unsigned int foldblock(char *p, char *out)
+{
+    vec_t x = LOAD(p);
+    vec_t upper = INRANGE(x, 'A', 'Z');
+
+    STORE(out, ADD(x, AND(upper, SPLAT(0x20))));
+    return MASK(upper);
+}
+
+#endif
+
+/*
+ * Returns the position of the first token character at or after pos,
+ * or size if there is none.
+ */
+static size_t findstart(char *data, size_t pos, size_t size)
+{
+#ifdef BLOCK
+    for (; pos + BLOCK <= size; pos += BLOCK)
+    {
+        unsigned int mask = classify(data + pos);
+
+        if (mask != 0)
+        {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (pos < size && !istokenchar(data[pos]))
+    {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+ * Returns the position of the first non-token character after start,
+ * but at most limit.  Blocks may be read up to size, past limit.
+ */
+static size_t findend(char *data, size_t start, size_t limit, size_t size)
+{
+    size_t pos = start;
+
+#ifdef BLOCK
+    for (; pos < limit && pos + BLOCK <= size; pos += BLOCK)
+    {
+        unsigned int mask = ~classify(data + pos) & ALLBITS;
+
+        if (mask != 0)
+        {
+            pos += __builtin_ctz(mask);
+            return pos < limit ? pos : limit;
+        }
+    }
+    if (pos >= limit)
+    {
+        return limit;
+    }
+#endif
+    while (pos < limit && istokenchar(data[pos]))
+    {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+ * Returns the len characters at text in lowercase: text itself if it
+ * has no uppercase letters, and otherwise a lowercased copy in out.
+ * avail is the number of readable bytes at text, which lets a short
+ * token be folded as one whole block.  Folding into a copy, rather
+ * than in place, keeps the mapping read-only, so it never takes
+ * copy-on-write faults.
+ */
+static char *fold(char *text, int len, size_t avail, char *out)
+{
+    unsigned int upper = 0;
+    int i = 0;
+
+#ifdef BLOCK
+    for (; i < len && avail - i >= BLOCK; i += BLOCK)
+    {
+        unsigned int mask = foldblock(text + i, out + i);
+
+        /* Ignore letters in the block past the end of the token */
+        if (len - i < BLOCK)
+        {
+            mask &= (1U << (len - i)) - 1;
+        }
+        upper |= mask;
+    }
+#endif
+    for (; i < len; i++)
+    {
+        int isupper = (unsigned char)(text[i] - 'A') < 26;
+
+        out[i] = text[i] + isupper * ('a' - 'A');
+        upper |= isupper;
+    }
+    return upper ? out : text;
+}
+
+tokenizer_t *tokenizer_open(char *filename)
+{
+    tokenizer_t *tokenizer;
+    struct stat st;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    tokenizer = malloc(sizeof(tokenizer_t));
+    if (tokenizer == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    tokenizer->data = NULL;
+    tokenizer->size = st.st_size;
+    tokenizer->mapped = 0;
+    tokenizer->pos = 0;
+
+    /* Empty files cannot be mapped, and have no tokens anyway */
+    if (tokenizer->size > 0)
+    {
+        void *data = mmap(NULL, tokenizer->size, PROT_READ, MAP_PRIVATE,
+                          fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            free(tokenizer);
+            close(fd);
+            return NULL;
+        }
+        tokenizer->data = data;
+        tokenizer->mapped = 1;
+#ifdef MADV_SEQUENTIAL
+        madvise(data, tokenizer->size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+    return tokenizer;
+}
+
+tokenizer_t *tokenizer_openbuf(char *data, size_t size)
+{
+    tokenizer_t *tokenizer = malloc(sizeof(tokenizer_t));
+
+    if (tokenizer == NULL)
+    {
+        return NULL;
+    }
+    tokenizer->data = data;
+    tokenizer->size = size;
+    tokenizer->mapped = 0;
+    tokenizer->pos = 0;
+    return tokenizer;
+}
+
+void tokenizer_close(tokenizer_t *tokenizer)
+{
+    if (tokenizer->mapped)
+    {
+        munmap(tokenizer->data, tokenizer->size);
+    }
+    free(tokenizer);
+}
+
+int tokenizer_next(tokenizer_t *tokenizer, token_t *token)
+{
+    char *data = tokenizer->data;
+    size_t size = tokenizer->size;
+    size_t start, end, limit;
+
+    start = findstart(data, tokenizer->pos, size);
+    if (start == size)
+    {
+        tokenizer->pos = size;
+        return 0;
+    }
+    limit = size - start < TOKEN_MAX ? size : start + TOKEN_MAX;
+    end = findend(data, start, limit, size);
+
+    token->text = fold(data + start, end - start, size - start,
+                       tokenizer->folded);
+    token->len = end - start;
+    tokenizer->pos = end;
+    return 1;
+}
+
+void tokenizer_foreach(tokenizer_t *tokenizer, tokenfunc_t func, void *arg)
+{
+    token_t token;
+
+    while (tokenizer_next(tokenizer, &token))
+    {
+        func(&token, arg);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+/*
+ * Tokens are maximal runs of the characters [a-zA-Z0-9'_], as read by
+ * tokenize_file; longer runs are split into tokens of at most this
+ * many characters.
+ */
+#define TOKEN_MAX 100
+
+/*
+ * A token: len characters starting at text, not NUL-terminated.  ASCII
+ * letters are lowercased, so tokens can be compared with memcmp (see
+ * intern_foldedn).  The text points into the tokenizer's mapping of
+ * the file (or into its buffer; see tokenizer_openbuf), or, for tokens
+ * that needed folding, into a buffer of the tokenizer that is reused
+ * by the next call to tokenizer_next.
+ */
+typedef struct token
+{
+    char *text;
+    int len;
+} token_t;
+
+/*
+ * The type of tokenizers.  A tokenizer maps a whole file into memory
+ * and hands out tokens as views into the mapping, so no token is ever
+ * copied or allocated.
+ */
+typedef struct tokenizer tokenizer_t;
+
+/*
+ * Maps the given file and returns a tokenizer positioned at its start.
+ * The file is only read, never modified.
+ * Returns NULL, with errno set, if the file cannot be opened or mapped.
+ */
+tokenizer_t *tokenizer_open(char *filename);
+
+/*
+ * Returns a tokenizer positioned at the start of the size bytes at
+ * data, such as a message read from a socket.  The bytes are only
+ * read, and must stay valid until the tokenizer is closed.
+ * Returns NULL if allocation failed.
+ */
+tokenizer_t *tokenizer_openbuf(char *data, size_t size);
+
+/*
+ * Unmaps the file, if any, and destroys the given tokenizer.  Every token it
+ * returned becomes invalid, so anything that must outlive the file
+ * (see intern_wordn) has to be copied first.
+ */
+void tokenizer_close(tokenizer_t *tokenizer);
+
+/*
+ * Stores the next token of the file in *token and returns 1, or
+ * returns 0 if there are no more tokens.
+ */
+int tokenizer_next(tokenizer_t *tokenizer, token_t *token);
+
+/*
+ * The type of token visitors, called with each token and the argument
+ * given to tokenizer_foreach.  The token is only valid during the call.
+ */
+typedef void (*tokenfunc_t)(token_t *token, void *arg);
+
+/*
+ * Calls func with every remaining token of the file, in order, so the
+ * caller can consume tokens as they are produced instead of collecting
+ * them first.
+ */
+void tokenizer_foreach(tokenizer_t *tokenizer, tokenfunc_t func, void *arg);
+
+#endif
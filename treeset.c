@@ -0,0 +1,1131 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "set.h"
+#include "sort.h"
+
+
+/*
+ * The type of tree nodes.  Each node knows its parent, so that
+ * iterators can step to the in-order successor without a stack.
+ */
+struct treenode;
+
+typedef struct treenode treenode_t;
+
+struct treenode
+{
+    treenode_t *left;
+    treenode_t *right;
+    treenode_t *parent;
+    void *elem;
+    int height;
+};
+
+/*
+ * The type of sets.
+ *
+ * The elements are kept in an AVL tree, so insertion and lookup are
+ * O(log n) in the worst case and an in-order walk visits the elements
+ * in ascending order without any sort step.
+ */
+struct set
+{
+    treenode_t *root;
+    cmpfunc_t cmpfunc;
+    int num_items;
+};
+
+struct set_iter
+{
+    treenode_t *node;
+};
+
+/*
+ * Intersections stop walking the larger tree, and look elements of
+ * the smaller one up in it instead, once it is at least this many
+ * times larger.
+ */
+#define PROBE_RATIO 16
+
+static treenode_t *newnode(void *elem, treenode_t *parent)
+{
+    treenode_t *node = malloc(sizeof(treenode_t));
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+    node->elem = elem;
+    node->height = 1;
+    return node;
+}
+
+static int height(treenode_t *node)
+{
+    return node != NULL ? node->height : 0;
+}
+
+static void updateheight(treenode_t *node)
+{
+    int lh = height(node->left);
+    int rh = height(node->right);
+
+    node->height = 1 + (lh > rh ? lh : rh);
+}
+
+/*
+ * Rotates the subtree rooted at y to the right, and returns the new
+ * root of the subtree.  The caller must update the child pointer of
+ * the parent.
+ */
+static treenode_t *rotateright(treenode_t *y)
+{
+    treenode_t *x = y->left;
+
+    y->left = x->right;
+    if (x->right != NULL)
+    {
+        x->right->parent = y;
+    }
+    x->right = y;
+    x->parent = y->parent;
+    y->parent = x;
+
+    updateheight(y);
+    updateheight(x);
+    return x;
+}
+
+/*
+ * Mirror image of rotateright.
+ */
+static treenode_t *rotateleft(treenode_t *x)
+{
+    treenode_t *y = x->right;
+
+    x->right = y->left;
+    if (y->left != NULL)
+    {
+        y->left->parent = x;
+    }
+    y->left = x;
+    y->parent = x->parent;
+    x->parent = y;
+
+    updateheight(x);
+    updateheight(y);
+    return y;
+}
+
+/*
+ * Restores the AVL invariant at the given node, assuming both of its
+ * subtrees are balanced.  Returns the new root of the subtree.
+ */
+static treenode_t *rebalance(treenode_t *node)
+{
+    int balance;
+
+    updateheight(node);
+    balance = height(node->left) - height(node->right);
+
+    if (balance > 1)
+    {
+        if (height(node->left->left) < height(node->left->right))
+        {
+            node->left = rotateleft(node->left);
+        }
+        node = rotateright(node);
+    }
+    else if (balance < -1)
+    {
+        if (height(node->right->right) < height(node->right->left))
+        {
+            node->right = rotateright(node->right);
+        }
+        node = rotateleft(node);
+    }
+    return node;
+}
+
+/*
+ * Inserts elem into the subtree rooted at node, and returns the new
+ * root of the subtree.  *added is set to 1 if a node was created.
+ */
+static treenode_t *insert(set_t *set, treenode_t *node, treenode_t *parent,
+                          void *elem, int *added)
+{
+    int cmp;
+
+    if (node == NULL)
+    {
+        node = newnode(elem, parent);
+        *added = node != NULL;
+        return node;
+    }
+
+    cmp = set->cmpfunc(elem, node->elem);
+    if (cmp < 0)
+    {
+        node->left = insert(set, node->left, node, elem, added);
+    }
+    else if (cmp > 0)
+    {
+        node->right = insert(set, node->right, node, elem, added);
+    }
+
+    if (!*added)
+    {
+        return node;
+    }
+    return rebalance(node);
+}
+
+static void destroytree(treenode_t *node)
+{
+    while (node != NULL)
+    {
+        treenode_t *right = node->right;
+
+        destroytree(node->left);
+        free(node);
+        node = right;
+    }
+}
+
+static treenode_t *leftmost(treenode_t *node)
+{
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    while (node->left != NULL)
+    {
+        node = node->left;
+    }
+    return node;
+}
+
+/*
+ * Returns the in-order successor of the given node, or NULL if it
+ * is the last node of the tree.
+ */
+static treenode_t *successor(treenode_t *node)
+{
+    if (node->right != NULL)
+    {
+        return leftmost(node->right);
+    }
+    while (node->parent != NULL && node->parent->right == node)
+    {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+/*
+ * Builds a perfectly balanced tree from the sorted array elems[lo..hi),
+ * and returns its root.  If a node cannot be allocated, the nodes
+ * built so far are freed and NULL is returned.
+ */
+static treenode_t *buildtree(void **elems, int lo, int hi, treenode_t *parent)
+{
+    int mid;
+    treenode_t *node;
+
+    if (lo >= hi)
+    {
+        return NULL;
+    }
+
+    mid = lo + (hi - lo) / 2;
+    node = newnode(elems[mid], parent);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->left = buildtree(elems, lo, mid, node);
+    node->right = buildtree(elems, mid + 1, hi, node);
+    if ((node->left == NULL && lo < mid) ||
+        (node->right == NULL && mid + 1 < hi))
+    {
+        destroytree(node);
+        return NULL;
+    }
+    updateheight(node);
+    return node;
+}
+
+/*
+ * Links the sorted array of existing nodes nodes[lo..hi) into a
+ * perfectly balanced tree, and returns its root.  Unlike buildtree,
+ * this allocates nothing.
+ */
+static treenode_t *linktree(treenode_t **nodes, int lo, int hi,
+                            treenode_t *parent)
+{
+    int mid;
+    treenode_t *node;
+
+    if (lo >= hi)
+    {
+        return NULL;
+    }
+
+    mid = lo + (hi - lo) / 2;
+    node = nodes[mid];
+    node->parent = parent;
+    node->left = linktree(nodes, lo, mid, node);
+    node->right = linktree(nodes, mid + 1, hi, node);
+    updateheight(node);
+    return node;
+}
+
+/*
+ * Replaces the tree of the given set with one built from the n sorted,
+ * unique elements in elems.  The old tree is not freed; it is empty or
+ * owned by the caller.  Returns 1 on success, and 0 if allocation
+ * failed, in which case the set is unchanged.
+ */
+static int settree(set_t *set, void **elems, int n)
+{
+    treenode_t *root = buildtree(elems, 0, n, NULL);
+
+    if (root == NULL && n > 0)
+    {
+        return 0;
+    }
+    set->root = root;
+    set->num_items = n;
+    return 1;
+}
+
+/*
+ * Returns a newly allocated array holding the elements of the given
+ * set in ascending order, or NULL if the allocation failed.  An empty
+ * set yields a valid one-slot array.
+ */
+static void **toarray(set_t *set)
+{
+    void **elems = malloc((set->num_items + 1) * sizeof(void *));
+    treenode_t *node;
+    int n = 0;
+
+    if (elems == NULL)
+    {
+        return NULL;
+    }
+    for (node = leftmost(set->root); node != NULL; node = successor(node))
+    {
+        elems[n++] = node->elem;
+    }
+    return elems;
+}
+
+/*
+ * Returns the node of the given set holding an element equal to elem,
+ * or NULL if there is none.
+ */
+static treenode_t *lookup(set_t *set, void *elem)
+{
+    treenode_t *node = set->root;
+
+    while (node != NULL)
+    {
+        int cmp = set->cmpfunc(elem, node->elem);
+
+        if (cmp == 0)
+        {
+            return node;
+        }
+        node = cmp < 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+/*
+ * Collects the elements of a that are also in b into out, in ascending
+ * order, unless out is NULL.  If stop is set, returns as soon as one
+ * common element is found.  Returns the number of common elements.
+ *
+ * Trees of similar size are merged with an in-order walk of both.
+ * When one tree is much smaller, only it is walked, and each of its
+ * elements is looked up in the larger tree, so the cost is
+ * O(m log n) for sizes m < n rather than O(m + n).
+ */
+static int collectcommon(set_t *a, set_t *b, void **out, int stop)
+{
+    treenode_t *na, *nb;
+    int count = 0;
+
+    if ((long)a->num_items * PROBE_RATIO <= b->num_items)
+    {
+        for (na = leftmost(a->root); na != NULL; na = successor(na))
+        {
+            if (lookup(b, na->elem) != NULL)
+            {
+                if (out != NULL)
+                {
+                    out[count] = na->elem;
+                }
+                count++;
+                if (stop)
+                {
+                    break;
+                }
+            }
+        }
+        return count;
+    }
+    if ((long)b->num_items * PROBE_RATIO <= a->num_items)
+    {
+        for (nb = leftmost(b->root); nb != NULL; nb = successor(nb))
+        {
+            na = lookup(a, nb->elem);
+            if (na != NULL)
+            {
+                if (out != NULL)
+                {
+                    out[count] = na->elem;
+                }
+                count++;
+                if (stop)
+                {
+                    break;
+                }
+            }
+        }
+        return count;
+    }
+
+    na = leftmost(a->root);
+    nb = leftmost(b->root);
+    while (na != NULL && nb != NULL)
+    {
+        int cmp = a->cmpfunc(na->elem, nb->elem);
+
+        if (cmp < 0)
+        {
+            na = successor(na);
+        }
+        else if (cmp > 0)
+        {
+            nb = successor(nb);
+        }
+        else
+        {
+            if (out != NULL)
+            {
+                out[count] = na->elem;
+            }
+            count++;
+            if (stop)
+            {
+                break;
+            }
+            na = successor(na);
+            nb = successor(nb);
+        }
+    }
+    return count;
+}
+
+/*
+ * Creates a new set using the given comparison function
+ * to compare elements of the set.
+ */
+set_t *set_create(cmpfunc_t cmpfunc)
+{
+    set_t *set = malloc(sizeof(set_t));
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    set->root = NULL;
+    set->cmpfunc = cmpfunc;
+    set->num_items = 0;
+    return set;
+}
+
+/*
+ * Creates a new set using the given comparison function to compare
+ * elements of the set.  This implementation does not hash its
+ * elements, so the hash function is ignored.
+ */
+set_t *set_createhash(cmpfunc_t cmpfunc, hashfunc_t hashfunc)
+{
+    return set_create(cmpfunc);
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  The
+ * elements are sorted and deduplicated once, and a balanced tree is
+ * built from them directly.
+ */
+set_t *set_create_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    set_t *set = set_create(cmpfunc);
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    if (!set_add_batch(set, elems, n))
+    {
+        set_destroy(set);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Creates a new set holding the elements of the given list.
+ */
+set_t *set_create_from_list(cmpfunc_t cmpfunc, list_t *list)
+{
+    int n = list_size(list);
+    void **elems = malloc((n + 1) * sizeof(void *));
+    list_iter_t *iter;
+    set_t *set;
+    int i = 0;
+
+    if (elems == NULL)
+    {
+        return NULL;
+    }
+
+    iter = list_createiter(list);
+    while (list_hasnext(iter))
+    {
+        elems[i++] = list_next(iter);
+    }
+    list_destroyiter(iter);
+
+    set = set_create_from_array(cmpfunc, elems, n);
+    free(elems);
+    return set;
+}
+
+/*
+ * Creates a new set holding the n elements of the given array.  This
+ * implementation does not hash its elements, so the hash function is
+ * ignored.
+ */
+set_t *set_createhash_from_array(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                 void **elems, int n)
+{
+    return set_create_from_array(cmpfunc, elems, n);
+}
+
+/*
+ * Creates a new set holding the elements of the given list, ignoring
+ * the hash function as above.
+ */
+set_t *set_createhash_from_list(cmpfunc_t cmpfunc, hashfunc_t hashfunc,
+                                list_t *list)
+{
+    return set_create_from_list(cmpfunc, list);
+}
+
+/*
+ * Destroys the given set.  Subsequently accessing the set
+ * will lead to undefined behavior.
+ */
+void set_destroy(set_t *set)
+{
+    destroytree(set->root);
+    free(set);
+}
+
+/*
+ * Returns the size (cardinality) of the given set.
+ */
+int set_size(set_t *set)
+{
+    return set->num_items;
+}
+
+/*
+ * Adds the given element to the given set.
+ */
+void set_add(set_t *set, void *elem)
+{
+    int added = 0;
+
+    set->root = insert(set, set->root, NULL, elem, &added);
+    set->num_items += added;
+}
+
+/*
+ * Adds the n elements of the given array to the given set.
+ *
+ * A batch that is small compared to the set is inserted one element
+ * at a time.  Otherwise the batch is sorted and deduplicated, merged
+ * with an in-order walk of the tree, and the tree is rebuilt from the
+ * merged sequence in linear time.
+ */
+int set_add_batch(set_t *set, void **elems, int n)
+{
+    void **batch, **merged;
+    treenode_t *node, *old;
+    int i, j = 0, k, m = 0, ok;
+
+    if (n == 0)
+    {
+        return 1;
+    }
+    if (n < set->num_items / 16)
+    {
+        for (i = 0; i < n; i++)
+        {
+            set_add(set, elems[i]);
+        }
+        return 1;
+    }
+
+    batch = malloc(n * sizeof(void *));
+    if (batch == NULL)
+    {
+        return 0;
+    }
+    memcpy(batch, elems, n * sizeof(void *));
+    k = sort_unique(batch, n, set->cmpfunc);
+    if (set->root == NULL)
+    {
+        ok = settree(set, batch, k);
+        free(batch);
+        return ok;
+    }
+
+    merged = malloc((set->num_items + k) * sizeof(void *));
+    if (merged == NULL)
+    {
+        free(batch);
+        return 0;
+    }
+
+    node = leftmost(set->root);
+    while (node != NULL && j < k)
+    {
+        int cmp = set->cmpfunc(node->elem, batch[j]);
+
+        if (cmp <= 0)
+        {
+            merged[m++] = node->elem;
+            node = successor(node);
+            if (cmp == 0)
+            {
+                j++;
+            }
+        }
+        else
+        {
+            merged[m++] = batch[j++];
+        }
+    }
+    for (; node != NULL; node = successor(node))
+    {
+        merged[m++] = node->elem;
+    }
+    while (j < k)
+    {
+        merged[m++] = batch[j++];
+    }
+
+    old = set->root;
+    ok = settree(set, merged, m);
+    if (ok)
+    {
+        destroytree(old);
+    }
+    free(merged);
+    free(batch);
+    return ok;
+}
+
+/*
+ * Returns 1 if the given element is contained in
+ * the given set, 0 otherwise.
+ */
+int set_contains(set_t *set, void *elem)
+{
+    return lookup(set, elem) != NULL;
+}
+
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ *
+ * Both trees are walked in order and merged into a sorted array,
+ * from which a balanced tree is built in linear time.
+ */
+set_t *set_union(set_t *a, set_t *b)
+{
+    set_t *union_set = set_create(a->cmpfunc);
+    treenode_t *na = leftmost(a->root), *nb = leftmost(b->root);
+    void **elems;
+    int n = 0;
+
+    if (union_set == NULL)
+    {
+        return NULL;
+    }
+    elems = malloc((a->num_items + b->num_items + 1) * sizeof(void *));
+    if (elems == NULL)
+    {
+        return union_set;
+    }
+
+    while (na != NULL && nb != NULL)
+    {
+        int cmp = a->cmpfunc(na->elem, nb->elem);
+
+        if (cmp <= 0)
+        {
+            elems[n++] = na->elem;
+            na = successor(na);
+            if (cmp == 0)
+            {
+                nb = successor(nb);
+            }
+        }
+        else
+        {
+            elems[n++] = nb->elem;
+            nb = successor(nb);
+        }
+    }
+    for (; na != NULL; na = successor(na))
+    {
+        elems[n++] = na->elem;
+    }
+    for (; nb != NULL; nb = successor(nb))
+    {
+        elems[n++] = nb->elem;
+    }
+
+    settree(union_set, elems, n);
+    free(elems);
+    return union_set;
+}
+
+/*
+ * Returns the intersection of the two given sets; the
+ * returned set contains all elements that are contained
+ * in both a and b.
+ */
+set_t *set_intersection(set_t *a, set_t *b)
+{
+    set_t *intersection_set = set_create(a->cmpfunc);
+    int max = a->num_items < b->num_items ? a->num_items : b->num_items;
+    void **elems;
+
+    if (intersection_set == NULL)
+    {
+        return NULL;
+    }
+    elems = malloc((max + 1) * sizeof(void *));
+    if (elems == NULL)
+    {
+        return intersection_set;
+    }
+
+    settree(intersection_set, elems, collectcommon(a, b, elems, 0));
+    free(elems);
+    return intersection_set;
+}
+
+/*
+ * Returns the set difference of the two given sets; the
+ * returned set contains all elements that are contained
+ * in a and not in b.
+ */
+set_t *set_difference(set_t *a, set_t *b)
+{
+    set_t *difference_set = set_create(a->cmpfunc);
+    treenode_t *na = leftmost(a->root), *nb = leftmost(b->root);
+    void **elems;
+    int n = 0;
+
+    if (difference_set == NULL)
+    {
+        return NULL;
+    }
+    elems = malloc((a->num_items + 1) * sizeof(void *));
+    if (elems == NULL)
+    {
+        return difference_set;
+    }
+
+    while (na != NULL && nb != NULL)
+    {
+        int cmp = a->cmpfunc(na->elem, nb->elem);
+
+        if (cmp < 0)
+        {
+            elems[n++] = na->elem;
+            na = successor(na);
+        }
+        else if (cmp > 0)
+        {
+            nb = successor(nb);
+        }
+        else
+        {
+            na = successor(na);
+            nb = successor(nb);
+        }
+    }
+    for (; na != NULL; na = successor(na))
+    {
+        elems[n++] = na->elem;
+    }
+
+    settree(difference_set, elems, n);
+    free(elems);
+    return difference_set;
+}
+
+/*
+ * Merges b into a, in place.  aonly, both and bonly select whether
+ * elements found only in a, in both sets, or only in b are kept.
+ *
+ * The nodes of a that survive are reused as they are; only elements
+ * taken from b need new nodes.  Both trees are walked in order, and
+ * the kept nodes are relinked into a balanced tree afterwards.
+ */
+static void mergeinplace(set_t *a, set_t *b, int aonly, int both, int bonly)
+{
+    int max = a->num_items + (bonly ? b->num_items : 0);
+    treenode_t **nodes = malloc((max + 1) * sizeof(treenode_t *));
+    treenode_t *na = leftmost(a->root), *nb = leftmost(b->root);
+    treenode_t *dropped = NULL;
+    int n = 0;
+
+    if (nodes == NULL)
+    {
+        return;
+    }
+
+    while (na != NULL || (bonly && nb != NULL))
+    {
+        int cmp = na == NULL ? 1 : nb == NULL ? -1 : a->cmpfunc(na->elem, nb->elem);
+
+        if (cmp > 0)
+        {
+            if (bonly)
+            {
+                treenode_t *node = newnode(nb->elem, NULL);
+                if (node != NULL)
+                {
+                    nodes[n++] = node;
+                }
+            }
+            nb = successor(nb);
+        }
+        else
+        {
+            treenode_t *next = successor(na);
+
+            if (cmp < 0 ? aonly : both)
+            {
+                nodes[n++] = na;
+            }
+            else
+            {
+                /*
+                 * The walk may still step up through this node's parent
+                 * pointer, so it is only freed once the walk is done.
+                 * Its left pointer is never followed again, and is
+                 * reused to chain the dropped nodes.
+                 */
+                na->left = dropped;
+                dropped = na;
+            }
+            if (cmp == 0)
+            {
+                nb = successor(nb);
+            }
+            na = next;
+        }
+    }
+
+    while (dropped != NULL)
+    {
+        treenode_t *tmp = dropped;
+        dropped = dropped->left;
+        free(tmp);
+    }
+
+    a->root = linktree(nodes, 0, n, NULL);
+    a->num_items = n;
+    free(nodes);
+}
+
+/*
+ * Replaces the contents of a with the intersection of a and b.
+ */
+void set_intersect_inplace(set_t *a, set_t *b)
+{
+    if (a != b)
+    {
+        mergeinplace(a, b, 0, 1, 0);
+    }
+}
+
+/*
+ * Replaces the contents of a with the union of a and b.
+ */
+void set_union_inplace(set_t *a, set_t *b)
+{
+    if (a != b)
+    {
+        mergeinplace(a, b, 1, 1, 1);
+    }
+}
+
+/*
+ * Removes from a every element that is contained in b.
+ */
+void set_subtract_inplace(set_t *a, set_t *b)
+{
+    if (a == b)
+    {
+        destroytree(a->root);
+        a->root = NULL;
+        a->num_items = 0;
+        return;
+    }
+    mergeinplace(a, b, 1, 0, 0);
+}
+
+/*
+ * Returns the intersection of the n given sets.
+ *
+ * The smallest set drives the search: each of its elements is looked
+ * up in the other sets and dropped at the first miss.  The survivors
+ * come out in order, so the result tree is built in linear time.
+ */
+set_t *set_intersection_many(set_t **sets, int n)
+{
+    set_t *smallest = sets[0];
+    set_t *result = set_create(sets[0]->cmpfunc);
+    treenode_t *node;
+    void **elems;
+    int i, count = 0, ok;
+
+    for (i = 1; i < n; i++)
+    {
+        if (sets[i]->num_items < smallest->num_items)
+        {
+            smallest = sets[i];
+        }
+    }
+
+    elems = malloc((smallest->num_items + 1) * sizeof(void *));
+    if (result == NULL || elems == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(elems);
+        return NULL;
+    }
+
+    for (node = leftmost(smallest->root); node != NULL; node = successor(node))
+    {
+        int found = 1;
+
+        for (i = 0; i < n && found; i++)
+        {
+            if (sets[i] != smallest)
+            {
+                found = set_contains(sets[i], node->elem);
+            }
+        }
+        if (found)
+        {
+            elems[count++] = node->elem;
+        }
+    }
+
+    ok = settree(result, elems, count);
+    free(elems);
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Returns the union of the n given sets.  The in-order contents of
+ * each tree are combined with a k-way heap merge, and the result tree
+ * is built from the merged sequence.
+ */
+set_t *set_union_many(set_t **sets, int n)
+{
+    void ***arrays = calloc(n, sizeof(void **));
+    int *sizes = malloc(n * sizeof(int));
+    set_t *result = set_create(sets[0]->cmpfunc);
+    void **merged;
+    int i, total = 0, ok = 1;
+
+    if (result == NULL || arrays == NULL || sizes == NULL)
+    {
+        if (result != NULL)
+        {
+            set_destroy(result);
+        }
+        free(arrays);
+        free(sizes);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        sizes[i] = sets[i]->num_items;
+        arrays[i] = toarray(sets[i]);
+        ok = ok && arrays[i] != NULL;
+        total += sizes[i];
+    }
+
+    merged = malloc((total + 1) * sizeof(void *));
+    if (ok && merged != NULL)
+    {
+        int count = sort_mergeunique(arrays, sizes, n, merged, result->cmpfunc);
+
+        ok = count >= 0 && settree(result, merged, count);
+    }
+    else
+    {
+        ok = 0;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        free(arrays[i]);
+    }
+    free(arrays);
+    free(sizes);
+    free(merged);
+    if (!ok)
+    {
+        set_destroy(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Counts the elements that a and b have in common.  If stop is set,
+ * returns as soon as one common element is found.
+ */
+static int countcommon(set_t *a, set_t *b, int stop)
+{
+    return collectcommon(a, b, NULL, stop);
+}
+
+/*
+ * Returns the number of elements contained in both a and b.
+ */
+int set_intersection_size(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 0);
+}
+
+/*
+ * Returns the number of elements contained in a and not in b.
+ */
+int set_difference_size(set_t *a, set_t *b)
+{
+    return set_size(a) - countcommon(a, b, 0);
+}
+
+/*
+ * Returns 1 if a and b have at least one element in common.
+ */
+int set_intersects(set_t *a, set_t *b)
+{
+    return countcommon(a, b, 1) > 0;
+}
+
+/*
+ * Returns a copy of the given set.
+ */
+set_t *set_copy(set_t *set)
+{
+    set_t *copied_set = set_create(set->cmpfunc);
+    void **elems;
+
+    if (copied_set == NULL)
+    {
+        return NULL;
+    }
+    elems = toarray(set);
+    if (elems == NULL)
+    {
+        return copied_set;
+    }
+
+    settree(copied_set, elems, set->num_items);
+    free(elems);
+    return copied_set;
+}
+
+/*
+ * Creates a new set iterator for iterating over the given set.
+ * Elements are returned in ascending order.
+ */
+set_iter_t *set_createiter(set_t *set)
+{
+    set_iter_t *set_iter = malloc(sizeof(set_iter_t));
+    if (set_iter == NULL)
+    {
+        return NULL;
+    }
+
+    set_iter->node = leftmost(set->root);
+    return set_iter;
+}
+
+/*
+ * Destroys the given set iterator.
+ */
+void set_destroyiter(set_iter_t *iter)
+{
+    free(iter);
+}
+
+/*
+ * Returns 0 if the given set iterator has reached the end of the
+ * set, or 1 otherwise.
+ */
+int set_hasnext(set_iter_t *iter)
+{
+    return iter->node != NULL;
+}
+
+/*
+ * Returns the next element in the sequence represented by the given
+ * set iterator.
+ */
+void *set_next(set_iter_t *iter)
+{
+    void *elem;
+
+    if (iter->node == NULL)
+    {
+        return NULL;
+    }
+    elem = iter->node->elem;
+    iter->node = successor(iter->node);
+    return elem;
+}
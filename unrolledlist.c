@@ -0,0 +1,533 @@
+#include "list.h"
+#include "sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * An unrolled linked list: each node (chunk) holds up to CHUNK_SIZE
+ * elements in a contiguous array, so scans touch one cache line per
+ * several elements instead of chasing a pointer for each one, and the
+ * per-element overhead is a small fraction of a pointer.
+ *
+ * A chunk, with its two links and two counts, fills exactly
+ * CHUNK_LINES cache lines.  With one line, a chunk would hold only 5
+ * elements on a 64-bit machine, and the links and counts would take
+ * more than a third of it; with two, it holds 13, for an overhead of
+ * less than two bytes per element.  malloc only aligns to 16 bytes,
+ * so a chunk may start mid-line and touch one line more than that.
+ */
+#define CACHE_LINE 64
+#define CHUNK_LINES 2
+#define CHUNK_HEADER (2 * sizeof(void *) + 2 * sizeof(int))
+#define CHUNK_SIZE \
+    ((int)((CACHE_LINE * CHUNK_LINES - CHUNK_HEADER) / sizeof(void *)))
+
+struct chunk;
+
+typedef struct chunk chunk_t;
+
+/*
+ * The elements of a chunk are elems[start..start+count).  Appending
+ * grows a chunk to the right and prepending grows it to the left, so
+ * both ends of the list take new elements in O(1).
+ */
+struct chunk {
+    chunk_t *next;
+    chunk_t *prev;
+    int start;
+    int count;
+    void *elems[CHUNK_SIZE];
+};
+
+struct list {
+    chunk_t *head;
+    chunk_t *tail;
+    int size;
+    cmpfunc_t cmpfunc;
+    listpool_t *pool;
+};
+
+/*
+ * Pools recycle whole chunks.  Chunks of destroyed lists are kept on
+ * the free list and freed only when the pool is destroyed.
+ */
+struct listpool {
+    chunk_t *free;      /* Returned chunks, linked through next */
+};
+
+struct list_iter {
+    chunk_t *chunk;
+    int index;
+};
+
+listpool_t *listpool_create(void)
+{
+    listpool_t *pool = malloc(sizeof(listpool_t));
+    if (pool == NULL)
+        return NULL;
+
+    pool->free = NULL;
+    return pool;
+}
+
+void listpool_destroy(listpool_t *pool)
+{
+    chunk_t *chunk = pool->free;
+    while (chunk != NULL) {
+        chunk_t *tmp = chunk;
+        chunk = chunk->next;
+        free(tmp);
+    }
+    free(pool);
+}
+
+/*
+ * Returns a new, empty chunk whose elements will start at the given
+ * index.
+ */
+static chunk_t *newchunk(list_t *list, int start)
+{
+    chunk_t *chunk;
+
+    if (list->pool != NULL && list->pool->free != NULL) {
+        chunk = list->pool->free;
+        list->pool->free = chunk->next;
+    }
+    else {
+        chunk = malloc(sizeof(chunk_t));
+        if (chunk == NULL)
+            return NULL;
+    }
+    chunk->next = NULL;
+    chunk->prev = NULL;
+    chunk->start = start;
+    chunk->count = 0;
+    return chunk;
+}
+
+static void freechunk(list_t *list, chunk_t *chunk)
+{
+    if (list->pool != NULL) {
+        chunk->next = list->pool->free;
+        list->pool->free = chunk;
+    }
+    else {
+        free(chunk);
+    }
+}
+
+list_t *list_create(cmpfunc_t cmpfunc)
+{
+    return list_createpooled(cmpfunc, NULL);
+}
+
+list_t *list_createpooled(cmpfunc_t cmpfunc, listpool_t *pool)
+{
+    list_t *list = malloc(sizeof(list_t));
+    if (list == NULL)
+        return NULL;
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->size = 0;
+    list->cmpfunc = cmpfunc;
+    list->pool = pool;
+    return list;
+}
+
+void list_destroy(list_t *list)
+{
+    chunk_t *chunk = list->head;
+
+    /* Pooled chunks are already chained; hand them all back at once */
+    if (list->pool != NULL) {
+        if (list->tail != NULL) {
+            list->tail->next = list->pool->free;
+            list->pool->free = list->head;
+        }
+        free(list);
+        return;
+    }
+    while (chunk != NULL) {
+        chunk_t *tmp = chunk;
+        chunk = chunk->next;
+        free(tmp);
+    }
+    free(list);
+}
+
+int list_size(list_t *list)
+{
+    return list->size;
+}
+
+int list_addfirst(list_t *list, void *elem)
+{
+    chunk_t *chunk = list->head;
+
+    if (chunk == NULL || chunk->start == 0) {
+        /* Fill the new chunk from the right, so later prepends fit */
+        chunk = newchunk(list, CHUNK_SIZE);
+        if (chunk == NULL)
+            return 0;
+        if (list->head == NULL) {
+            list->tail = chunk;
+        }
+        else {
+            list->head->prev = chunk;
+            chunk->next = list->head;
+        }
+        list->head = chunk;
+    }
+    chunk->elems[--chunk->start] = elem;
+    chunk->count++;
+    list->size++;
+    return 1;
+}
+
+int list_addlast(list_t *list, void *elem)
+{
+    chunk_t *chunk = list->tail;
+
+    if (chunk == NULL || chunk->start + chunk->count == CHUNK_SIZE) {
+        chunk = newchunk(list, 0);
+        if (chunk == NULL)
+            return 0;
+        if (list->tail == NULL) {
+            list->head = chunk;
+        }
+        else {
+            list->tail->next = chunk;
+            chunk->prev = list->tail;
+        }
+        list->tail = chunk;
+    }
+    chunk->elems[chunk->start + chunk->count++] = elem;
+    list->size++;
+    return 1;
+}
+
+void *list_popfirst(list_t *list)
+{
+    chunk_t *chunk = list->head;
+    void *elem;
+
+    if (chunk == NULL)
+        return NULL;
+
+    elem = chunk->elems[chunk->start++];
+    list->size--;
+    if (--chunk->count == 0) {
+        list->head = chunk->next;
+        if (list->head == NULL)
+            list->tail = NULL;
+        else
+            list->head->prev = NULL;
+        freechunk(list, chunk);
+    }
+    return elem;
+}
+
+void *list_poplast(list_t *list)
+{
+    chunk_t *chunk = list->tail;
+    void *elem;
+
+    if (chunk == NULL)
+        return NULL;
+
+    elem = chunk->elems[chunk->start + --chunk->count];
+    list->size--;
+    if (chunk->count == 0) {
+        list->tail = chunk->prev;
+        if (list->tail == NULL)
+            list->head = NULL;
+        else
+            list->tail->next = NULL;
+        freechunk(list, chunk);
+    }
+    return elem;
+}
+
+int list_contains(list_t *list, void *elem)
+{
+    chunk_t *chunk;
+    int i;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        for (i = chunk->start; i < chunk->start + chunk->count; i++) {
+            if (list->cmpfunc(elem, chunk->elems[i]) == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the elements of the given list in a newly allocated array,
+ * or NULL if allocation failed.
+ */
+static void **toarray(list_t *list)
+{
+    void **array = malloc((list->size + 1) * sizeof(void *));
+    chunk_t *chunk;
+    int i, n = 0;
+
+    if (array == NULL)
+        return NULL;
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        for (i = 0; i < chunk->count; i++)
+            array[n++] = chunk->elems[chunk->start + i];
+    }
+    return array;
+}
+
+/*
+ * Writes the given array of list->size elements back into the list,
+ * packed into full chunks starting from the head, and releases any
+ * chunks left over at the tail.
+ */
+static void fromarray(list_t *list, void **array)
+{
+    chunk_t *chunk, *next;
+    int i, n = 0;
+
+    for (chunk = list->head; n < list->size; chunk = chunk->next) {
+        chunk->start = 0;
+        chunk->count = list->size - n < CHUNK_SIZE ?
+            list->size - n : CHUNK_SIZE;
+        for (i = 0; i < chunk->count; i++)
+            chunk->elems[i] = array[n++];
+        list->tail = chunk;
+    }
+
+    chunk = list->tail->next;
+    list->tail->next = NULL;
+    while (chunk != NULL) {
+        next = chunk->next;
+        freechunk(list, chunk);
+        chunk = next;
+    }
+}
+
+/*
+ * Sorts the list where it lies, by insertion: each element is moved
+ * back, across chunk boundaries, past the larger elements before it.
+ * Needs no memory, but takes O(n^2) time unless the list is nearly
+ * sorted, so it is only a fallback for list_sort.
+ */
+static void insertionsort(list_t *list)
+{
+    chunk_t *chunk, *c, *pc;
+    void *elem;
+    int i, j, pj;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        for (i = chunk->start; i < chunk->start + chunk->count; i++) {
+            elem = chunk->elems[i];
+            c = chunk;
+            j = i;
+            for (;;) {
+                /* Find the position before c->elems[j] */
+                pc = c;
+                pj = j - 1;
+                if (pj < c->start) {
+                    pc = c->prev;
+                    if (pc == NULL)
+                        break;
+                    pj = pc->start + pc->count - 1;
+                }
+                if (list->cmpfunc(pc->elems[pj], elem) <= 0)
+                    break;
+                c->elems[j] = pc->elems[pj];
+                c = pc;
+                j = pj;
+            }
+            c->elems[j] = elem;
+        }
+    }
+}
+
+/*
+ * Sorts the elements in a flat array, and then writes them back into
+ * the chunks.  If the array cannot be allocated, the list is sorted
+ * in place instead, more slowly.
+ */
+void list_sort(list_t *list)
+{
+    void **array;
+
+    if (list->size < 2)
+        return;
+
+    array = toarray(list);
+    if (array == NULL) {
+        insertionsort(list);
+        return;
+    }
+    sort_array(array, list->size, list->cmpfunc);
+    fromarray(list, array);
+    free(array);
+}
+
+/*
+ * A unit of work for list_sort_parallel.  If dst is NULL, sorts
+ * src[lo..hi) in place.  Otherwise merges the sorted ranges
+ * src[lo..mid) and src[mid..hi) into dst[lo..hi).
+ */
+typedef struct sortjob {
+    void **src;
+    void **dst;
+    int lo, mid, hi;
+    cmpfunc_t cmpfunc;
+    int threaded;
+} sortjob_t;
+
+static void *sortworker(void *arg)
+{
+    sortjob_t *job = arg;
+    void **src = job->src, **dst = job->dst;
+    int i = job->lo, j = job->mid, k = job->lo;
+
+    if (dst == NULL) {
+        sort_array(src + job->lo, job->hi - job->lo, job->cmpfunc);
+        return NULL;
+    }
+    while (i < job->mid && j < job->hi) {
+        if (job->cmpfunc(src[j], src[i]) < 0)
+            dst[k++] = src[j++];
+        else
+            dst[k++] = src[i++];
+    }
+    memcpy(dst + k, src + i, (job->mid - i) * sizeof(void *));
+    k += job->mid - i;
+    memcpy(dst + k, src + j, (job->hi - j) * sizeof(void *));
+    return NULL;
+}
+
+/*
+ * Runs jobs[0..n) in parallel, the last one on the calling thread.
+ * A job whose thread cannot be started runs on the calling thread.
+ */
+static void runjobs(sortjob_t *jobs, pthread_t *threads, int n)
+{
+    int i;
+
+    for (i = 0; i < n - 1; i++) {
+        jobs[i].threaded =
+            pthread_create(&threads[i], NULL, sortworker, &jobs[i]) == 0;
+        if (!jobs[i].threaded)
+            sortworker(&jobs[i]);
+    }
+    sortworker(&jobs[n - 1]);
+    for (i = 0; i < n - 1; i++) {
+        if (jobs[i].threaded)
+            pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+ * Sorts nthreads slices of a flat copy of the list in parallel, then
+ * merges neighbouring slices pairwise, alternating between the array
+ * and a buffer of the same size, until one sorted range is left.
+ */
+void list_sort_parallel(list_t *list, int nthreads)
+{
+    void **array, **buffer, **tmp;
+    sortjob_t *jobs;
+    pthread_t *threads;
+    int i, k, n;
+
+    if (nthreads < 2 || list->size < LIST_PARALLEL_THRESHOLD) {
+        list_sort(list);
+        return;
+    }
+    if (nthreads > list->size)
+        nthreads = list->size;
+
+    array = toarray(list);
+    buffer = malloc((list->size + 1) * sizeof(void *));
+    jobs = malloc(nthreads * sizeof(sortjob_t));
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (array == NULL || buffer == NULL || jobs == NULL || threads == NULL) {
+        free(array);
+        free(buffer);
+        free(jobs);
+        free(threads);
+        list_sort(list);
+        return;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        jobs[i].src = array;
+        jobs[i].dst = NULL;
+        jobs[i].lo = (long)list->size * i / nthreads;
+        jobs[i].hi = (long)list->size * (i + 1) / nthreads;
+        jobs[i].cmpfunc = list->cmpfunc;
+    }
+    runjobs(jobs, threads, nthreads);
+
+    /* Each round merges pairs of ranges; an odd one out is copied */
+    for (n = nthreads; n > 1; n = k) {
+        for (i = 0, k = 0; i < n; i += 2, k++) {
+            jobs[k].src = array;
+            jobs[k].dst = buffer;
+            jobs[k].lo = jobs[i].lo;
+            jobs[k].mid = jobs[i].hi;
+            jobs[k].hi = i + 1 < n ? jobs[i + 1].hi : jobs[i].hi;
+        }
+        runjobs(jobs, threads, k);
+        tmp = array;
+        array = buffer;
+        buffer = tmp;
+    }
+
+    fromarray(list, array);
+    free(array);
+    free(buffer);
+    free(jobs);
+    free(threads);
+}
+
+list_iter_t *list_createiter(list_t *list)
+{
+    list_iter_t *iter = malloc(sizeof(list_iter_t));
+    if (iter == NULL)
+        return NULL;
+
+    iter->chunk = list->head;
+    iter->index = list->head == NULL ? 0 : list->head->start;
+    return iter;
+}
+
+void list_destroyiter(list_iter_t *iter)
+{
+    free(iter);
+}
+
+int list_hasnext(list_iter_t *iter)
+{
+    if (iter->chunk == NULL)
+        return 0;
+    else
+        return 1;
+}
+
+void *list_next(list_iter_t *iter)
+{
+    chunk_t *chunk = iter->chunk;
+    void *elem;
+
+    if (chunk == NULL)
+        return NULL;
+
+    elem = chunk->elems[iter->index++];
+    if (iter->index == chunk->start + chunk->count) {
+        iter->chunk = chunk->next;
+        if (iter->chunk != NULL)
+            iter->index = iter->chunk->start;
+    }
+    return elem;
+}